@@ -0,0 +1,26 @@
+#!/bin/sh
+# lexer benchmark: xc -l tokenizes c.c, a large synthetic source made of N copies of it, and a
+# generated source declaring then using 100k distinct identifiers for symbol lookup, the time of
+# an empty source is taken off so startup does not count
+N=${N:-200}
+R=${R:-20}
+rm -f xc lexbig.c lexnull.c lexsym.c
+gcc -o xc -O3 -m32 -Ilinux -Iroot/lib root/bin/c.c
+: > lexnull.c
+i=0
+while [ $i -lt $N ]; do cat root/bin/c.c >> lexbig.c; i=$((i + 1)); done
+awk 'BEGIN { for (i = 0; i < 100000; i++) printf "int sym_%x;\n", i; for (i = 0; i < 100000; i++) printf "x = sym_%x;\n", i }' > lexsym.c
+run() {
+  t0=$(date +%s%N)
+  i=0
+  while [ $i -lt $R ]; do ./xc -l -Iroot/lib $1 2>/dev/null || { echo "lexbench: $1 failed"; exit 1; }; i=$((i + 1)); done
+  t1=$(date +%s%N)
+  t=$(( (t1 - t0) / R ))
+}
+run lexnull.c; t00=$t
+for f in root/bin/c.c lexbig.c lexsym.c; do
+  b=$(./xc -l -Iroot/lib $f 2>&1 | sed 's/.* lexed \([0-9]*\) bytes.*/\1/')
+  run $f; t=$(( t - t00 )); [ $t -gt 0 ] || t=1
+  echo "lexbench: $f $b bytes in $(( t / 1000 )) us, $(( b * 1000 / t )) MB/s"
+done
+rm -f lexbig.c lexnull.c lexsym.c
@@ -0,0 +1,16 @@
+#!/bin/sh
+# self hosting benchmark: c.c compiled by xc, run under em -u, compiles c.c again to the same bytes
+N=${N:-10}
+rm -f xc xem c1 c2
+gcc -o xc -O3 -m32 -Ilinux -Iroot/lib root/bin/c.c
+gcc -o xem -O3 -m32 -msse2 -Ilinux -Iroot/lib root/bin/em.c -lm
+./xc -o c1 -Iroot/lib root/bin/c.c
+t0=$(date +%s%N)
+i=0
+while [ $i -lt $N ]; do
+  ./xem -u c1 -Iroot/lib -o c2 root/bin/c.c </dev/null || { echo "self-host: c1 failed"; exit 1; }
+  i=$((i + 1))
+done
+t1=$(date +%s%N)
+cmp c1 c2 || { echo "self-host: c2 differs from c1 FAILED"; exit 1; }
+echo "self-host: c.c compiled under em $N times, $(( (t1 - t0) / 1000000 )) ms wall, $(( (t1 - t0) / 1000000 / N )) ms each, output identical ok"
@@ -1,10 +1,22 @@
 #!/bin/sh
-rm -f xc xem emhello funcall os0 os1 os2 os3
+rm -f xc xem emhello hello funcall vecbench mallocbench membench stdiobench os0 os1 os2 os3 os4 os5 os6 os7 os8 os9 os10
 gcc -o xc -O3 -m32 -Ilinux -Iroot/lib root/bin/c.c
-gcc -o xem -O3 -m32 -Ilinux -Iroot/lib root/bin/em.c -lm
+gcc -o xem -O3 -m32 -msse2 -Ilinux -Iroot/lib root/bin/em.c -lm
 ./xc -o emhello -Iroot/lib root/usr/emhello.c
+./xc -o hello -Iroot/lib root/usr/hello.c
 ./xc -o funcall -Iroot/lib root/usr/funcall.c
+./xc -o vecbench -Iroot/lib root/usr/vecbench.c
+./xc -o mallocbench -Iroot/lib root/usr/mallocbench.c
+./xc -o membench -Iroot/lib root/usr/membench.c
+./xc -o stdiobench -Iroot/lib root/usr/stdiobench.c
 ./xc -o os0 -Iroot/lib root/usr/os/os0.c
 ./xc -o os1 -Iroot/lib root/usr/os/os1.c
 ./xc -o os2 -Iroot/lib root/usr/os/os2.c
 ./xc -o os3 -Iroot/lib root/usr/os/os3.c
+./xc -o os4 -Iroot/lib root/usr/os/os4.c
+./xc -o os5 -Iroot/lib root/usr/os/os5.c
+./xc -o os6 -Iroot/lib root/usr/os/os6.c
+./xc -o os7 -Iroot/lib root/usr/os/os7.c
+./xc -o os8 -Iroot/lib root/usr/os/os8.c
+./xc -o os9 -Iroot/lib root/usr/os/os9.c
+./xc -o os10 -Iroot/lib root/usr/os/os10.c
@@ -1,2 +1,2 @@
 #!/bin/sh
-rm -f xc xem emhello os0 os1 os2 os3 xmkfs emhello funcall fs.img *.txt
+rm -f xc xem emhello hello os0 os1 os2 os3 xmkfs emhello funcall fs.img *.txt
@@ -11,7 +11,9 @@
 #include <stdarg.h>
 #include <termios.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
+#include <time.h>
 
 #define NOFILE 16 // XXX subject to change
 
@@ -136,7 +138,7 @@ int xfstat(int d, struct xstat *s)
     s->st_size  = 0;
     r = 0;
   } else if (!(r = fstat(xfd[d], &hs))) {
-    s->st_mode  = S_IFREG;
+    s->st_mode  = S_ISCHR(hs.st_mode) ? S_IFCHR : S_IFREG; // a redirected console fd is a file
     s->st_dev   = hs.st_dev;
     s->st_ino   = hs.st_ino;
     s->st_nlink = hs.st_nlink;
@@ -178,6 +180,11 @@ int xexec(char *path, char **argv) { printf("exec() not implemented\n"); exit(-1
 int xmknod(char *path, int mode, int dev) { printf("mknod() not implemented\n"); exit(-1); }
 int xlink(char *old, char *new) { printf("link() not implemented\n"); exit(-1); }
 int xgetpid(void) { printf("getpid() not implemented\n"); exit(-1); }
+void *xmmap(void *a, int n, int prot, int flags, int d, int off)
+{
+  if (!(flags & MAP_ANONYMOUS)) { if ((uint)d >= NOFILE || xft[d] != xFILE) return MAP_FAILED; d = xfd[d]; }
+  return mmap(a, n, prot, flags, d, off);
+}
 int xsleep(int n) { printf("sleep() not implemented\n"); exit(-1); }
 int xuptime(void) { printf("uptime() not implemented\n"); exit(-1); }
 int xmount(char *spec, char *dir, int rwflag) { printf("mount() not implemented\n"); exit(-1); }
@@ -234,3 +241,4 @@ int main(int argc, char *argv[])
 #define exit     xexit
 #define main     xmain
 #define sbrk     xsbrk
+#define mmap     xmmap
@@ -0,0 +1,39 @@
+// linux/vec.h
+// Host versions of the packed vector routines in root/lib/vec.h, used by em to implement
+// VADD, VXOR, VAND, VCEQ, VMN and VMX.  Each routine applies d[i] = op(d[i], s[i]) over n
+// bytes.  Word lanes are signed 32-bit, byte lanes are unsigned 8-bit.  SSE2/AVX2 when the
+// compiler targets them, scalar otherwise.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define VLOOP(T, x, y, op, v256, v128) \
+  for (; n >= 32; d += 32, s += 32, n -= 32) { __m256i x = _mm256_loadu_si256((__m256i *)d), y = _mm256_loadu_si256((__m256i *)s); _mm256_storeu_si256((__m256i *)d, v256); } \
+  for (; n >= 16; d += 16, s += 16, n -= 16) { __m128i x = _mm_loadu_si128((__m128i *)d), y = _mm_loadu_si128((__m128i *)s); _mm_storeu_si128((__m128i *)d, v128); } \
+  for (; n >= sizeof(T); d += sizeof(T), s += sizeof(T), n -= sizeof(T)) { T x = *(T *)d, y = *(T *)s; *(T *)d = op; }
+#elif defined(__SSE2__)
+#define VLOOP(T, x, y, op, v256, v128) \
+  for (; n >= 16; d += 16, s += 16, n -= 16) { __m128i x = _mm_loadu_si128((__m128i *)d), y = _mm_loadu_si128((__m128i *)s); _mm_storeu_si128((__m128i *)d, v128); } \
+  for (; n >= sizeof(T); d += sizeof(T), s += sizeof(T), n -= sizeof(T)) { T x = *(T *)d, y = *(T *)s; *(T *)d = op; }
+#else
+#define VLOOP(T, x, y, op, v256, v128) \
+  for (; n >= sizeof(T); d += sizeof(T), s += sizeof(T), n -= sizeof(T)) { T x = *(T *)d, y = *(T *)s; *(T *)d = op; }
+#endif
+
+// SSE2 has no 32-bit min/max, build them from a compare and a select
+#define VSEL128(m, x, y) _mm_or_si128(_mm_and_si128(m, x), _mm_andnot_si128(m, y))
+
+void vadd32(char *d, char *s, uint n) { VLOOP(int,   x, y, x + y,              _mm256_add_epi32(x, y),    _mm_add_epi32(x, y)) }
+void vadd8 (char *d, char *s, uint n) { VLOOP(uchar, x, y, x + y,              _mm256_add_epi8(x, y),     _mm_add_epi8(x, y)) }
+void vxor  (char *d, char *s, uint n) { VLOOP(uchar, x, y, x ^ y,              _mm256_xor_si256(x, y),    _mm_xor_si128(x, y)) }
+void vand  (char *d, char *s, uint n) { VLOOP(uchar, x, y, x & y,              _mm256_and_si256(x, y),    _mm_and_si128(x, y)) }
+void vceq32(char *d, char *s, uint n) { VLOOP(int,   x, y, (x == y) ? -1 : 0,  _mm256_cmpeq_epi32(x, y),  _mm_cmpeq_epi32(x, y)) }
+void vceq8 (char *d, char *s, uint n) { VLOOP(uchar, x, y, (x == y) ? 255 : 0, _mm256_cmpeq_epi8(x, y),   _mm_cmpeq_epi8(x, y)) }
+void vmin32(char *d, char *s, uint n) { VLOOP(int,   x, y, (x < y) ? x : y,    _mm256_min_epi32(x, y),    VSEL128(_mm_cmplt_epi32(x, y), x, y)) }
+void vmin8 (char *d, char *s, uint n) { VLOOP(uchar, x, y, (x < y) ? x : y,    _mm256_min_epu8(x, y),     _mm_min_epu8(x, y)) }
+void vmax32(char *d, char *s, uint n) { VLOOP(int,   x, y, (x > y) ? x : y,    _mm256_max_epi32(x, y),    VSEL128(_mm_cmpgt_epi32(x, y), x, y)) }
+void vmax8 (char *d, char *s, uint n) { VLOOP(uchar, x, y, (x > y) ? x : y,    _mm256_max_epu8(x, y),     _mm_max_epu8(x, y)) }
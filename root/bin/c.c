@@ -1,18 +1,20 @@
 // c -- c compiler
 //
-// Usage:  c [-v] [-s] [-Ipath] [-o exefile] file ...
+// Usage:  c [-v] [-s] [-l] [-Ipath] [-o exefile] [-m mapfile] file ...
 //
 // Description:
 //   c is the c compiler.  It takes a single source file and creates an executable
 //   file or else executes the compiled code immediately.  The compiler does not
 //   reach full standards compliance, so some programs need minor adjustment.
-//   There is no preprocessor, although the #include keyword is allowed
-//   supporting a single level of file inclusion.
+//   There is no preprocessor, although the #include keyword is allowed and
+//   includes nest.  A file with #pragma once, or whose text is all inside a
+//   #ifndef X / #define X ... #endif guard, is not read again.
 //
 //   The following options are supported:
 //
 //   -v  Verbose output.  Useful for finding undeclared function calls.
 //   -s  Print source and generated code.
+//   -l  Tokenize the source and its includes only, and report bytes and tokens.
 //   -I  Path to include files (otherwise source directory or /lib/.)
 //   -o  Create executable file and terminate normally.  If -o and -s are omitted,
 //       the compiled code is executed immediately (if there were no compile
@@ -29,6 +31,7 @@
 
 #include <u.h>
 #include <libc.h>
+#include <ops.h>
 
 enum {
   SEG_SZ    = 8*1024*1024, // max size of text+data+bss seg
@@ -36,7 +39,9 @@ enum {
   VAR_SZ    =     64*1024, // size of symbol table
   PSTACK_SZ =     64*1024, // size of patch stacks
   LSTACK_SZ =      4*1024, // size of locals stack
-  HASH_SZ   =      8*1024, // number of hash table entries
+  HASH_SZ   =      8*1024, // initial number of hash table slots, doubled at half full
+  ID_SZ     =     64*1024, // identifier pool refill size
+  INCL_MAX  =         200, // include nesting limit
   BSS_TAG   =  0x10000000, // tag for patching global offsets
 };
 
@@ -47,8 +52,8 @@ typedef struct ident_s {
   int local;
   uint tk;
   char *name;
-  int hash;
-  struct ident_s *next;
+  uint hash;
+  int len;
 } ident_t;
 
 typedef struct {
@@ -79,6 +84,22 @@ typedef struct {
   int size;
 } array_t;
 
+typedef struct file_s { // files read, one per path so a name is kept once
+  char *name;
+  int len;
+  uint dev, ino;    // identity, ino 0 when the file system has none
+  int once;         // not to be read again
+  struct file_s *next;
+} file_t;
+
+typedef struct incl_s { // include stack, the file that did the include
+  file_t *file;
+  char *pos;        // position after the include line
+  int line;
+  int gstate, gdepth; char *gpos; // its include guard tracking
+  struct incl_s *next;
+} incl_t;
+
 int tk,       // current token
     ts, ip,   // text segment, current pointer
     gs, data, // data segment, current offset
@@ -90,12 +111,20 @@ int tk,       // current token
     verbose,  // print additional verbiage
     debug,    // print source and object code
     ffun,     // unresolved forward function counter
+    mapfd,    // function address map for em, 0 when none
+    lexonly,  // only run the tokenizer
+    srcbytes, // bytes of source mapped
     va, vp,   // variable pool, current pointer
     *e,       // expression tree pointer
     *pdata,   // data segment patchup pointer
     *pbss;    // bss segment patchup pointer
 
-ident_t *id;  // current parsed identifier
+ident_t *id,  // current parsed identifier
+  **ht,       // identifier hash table, open addressed
+  *idp, *ide, // identifier pool, current pointer and end
+  *tmain;     // main, which libc's _start calls undeclared, so only main's own declaration types it
+int hmask,    // hash table slots - 1
+    hused;    // hash table slots in use
 double fval;  // current token double value
 uint ty,      // current parsed subexpression type
      rt,      // current parsed function return type
@@ -108,27 +137,14 @@ char *file,   // input file name
 
 loc_t *ploc;  // local variable stack pointer
 
-char ops[] =
-  "HALT,ENT ,LEV ,JMP ,JMPI,JSR ,JSRA,LEA ,LEAG,CYC ,MCPY,MCMP,MCHR,MSET," // system
-  "LL  ,LLS ,LLH ,LLC ,LLB ,LLD ,LLF ,LG  ,LGS ,LGH ,LGC ,LGB ,LGD ,LGF ," // load a
-  "LX  ,LXS ,LXH ,LXC ,LXB ,LXD ,LXF ,LI  ,LHI ,LIF ,"
-  "LBL ,LBLS,LBLH,LBLC,LBLB,LBLD,LBLF,LBG ,LBGS,LBGH,LBGC,LBGB,LBGD,LBGF," // load b
-  "LBX ,LBXS,LBXH,LBXC,LBXB,LBXD,LBXF,LBI ,LBHI,LBIF,LBA ,LBAD,"
-  "SL  ,SLH ,SLB ,SLD ,SLF ,SG  ,SGH ,SGB ,SGD ,SGF ,"                     // store
-  "SX  ,SXH ,SXB ,SXD ,SXF ,"
-  "ADDF,SUBF,MULF,DIVF,"                                                   // arithmetic
-  "ADD ,ADDI,ADDL,SUB ,SUBI,SUBL,MUL ,MULI,MULL,DIV ,DIVI,DIVL,"
-  "DVU ,DVUI,DVUL,MOD ,MODI,MODL,MDU ,MDUI,MDUL,AND ,ANDI,ANDL,"
-  "OR  ,ORI ,ORL ,XOR ,XORI,XORL,SHL ,SHLI,SHLL,SHR ,SHRI,SHRL,"
-  "SRU ,SRUI,SRUL,EQ  ,EQF ,NE  ,NEF ,LT  ,LTU ,LTF ,GE  ,GEU ,GEF ,"      // logical
-  "BZ  ,BZF ,BNZ ,BNZF,BE  ,BEF ,BNE ,BNEF,BLT ,BLTU,BLTF,BGE ,BGEU,BGEF," // conditional
-  "CID ,CUD ,CDI ,CDU ,"                                                   // conversion
-  "CLI ,STI ,RTI ,BIN ,BOUT,NOP ,SSP ,PSHA,PSHI,PSHF,PSHB,POPB,POPF,POPA," // misc
-  "IVEC,PDIR,SPAG,TIME,LVAD,TRAP,LUSP,SUSP,LCL ,LCA ,PSHC,POPC,MSIZ,"
-  "PSHG,POPG,NET1,NET2,NET3,NET4,NET5,NET6,NET7,NET8,NET9,"
-  "POW ,ATN2,FABS,ATAN,LOG ,LOGT,EXP ,FLOR,CEIL,HYPO,SIN ,COS ,TAN ,ASIN," // math
-  "ACOS,SINH,COSH,TANH,SQRT,FMOD,"
-  "IDLE,";
+incl_t *istk, // include stack
+       *ifree; // popped include stack entries
+file_t *files, // files read
+       *fcur;  // the input file
+int idepth,   // include nesting
+    gstate,   // include guard of the input file: 0 none, 1 inside it, 2 closed at gpos
+    gdepth;   // conditional nesting in the input file
+char *gpos;   // end of the #endif closing the guard
 
 // types and type masks. specific bit patterns and orderings needed by expr()
 enum {
@@ -187,14 +203,43 @@ void err(char *msg)
   if (++errs > 10) { dprintf(2,"%s : fatal: maximum errors exceeded\n", cmd); exit(-1); }
 }
 
-char *mapfile(char *name, int size) // XXX replace with mmap
+char *mapfile(char *name, int size) // source text, zero terminated
 {
   int f; char *p;
   if ((f = open(name, O_RDONLY)) < 0) { dprintf(2,"%s : [%s:%d] error: can't open file %s\n", cmd, file, line, name); exit(-1); }
-  p = new(size+1);
+  srcbytes += size;
+  if ((size & 4095) && (p = mmap(0, size, PROT_READ, MAP_PRIVATE, f, 0)) != (void *)-1) { close(f); return p; } // zero fill past the end terminates it
+  p = new(size+1); // no room left in the last page
   if (read(f, p, size) != size) { dprintf(2,"%s : [%s:%d] error: can't read file %s\n", cmd, file, line, name); exit(-1); }
   close(f);
-  p[size] = 0; // XXX redundant but need to map file!
+  p[size] = 0;
+  return p;
+}
+
+// wide word scanning -- source is read a word at a time from aligned addresses, so a word holding
+// the terminating zero never runs past the mapping
+uint haz(uint w) { return (w - 0x01010101) & ~w & 0x80808080; } // non-zero when a byte of w is zero
+
+char *skipto(char *p, uint a, uint b) // first byte at p that is a, b or the terminating zero
+{
+  uint w;
+  while ((int)p & 3) { if (!*p || *p == a || *p == b) return p; p++; }
+  a *= 0x01010101; b *= 0x01010101;
+  for (;;) {
+    w = *(uint *)p;
+    if (haz(w) | haz(w ^ a) | haz(w ^ b)) break;
+    p += 4;
+  }
+  a &= 0xff; b &= 0xff;
+  while (*p && *p != a && *p != b) p++;
+  return p;
+}
+
+char *skipws(char *p) // past blanks and tabs, indentation a word at a time
+{
+  while (*p == ' ' || *p == '\t') {
+    if (!((int)p & 3) && *(uint *)p == 0x20202020) p += 4; else p++;
+  }
   return p;
 }
 
@@ -246,26 +291,97 @@ void dline()
   printf("%s  %d: %.*s\n", file, line, p - pos, pos);
 }
 
+int idchar(int c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$'; }
+
+file_t *fintern(char *name, int len, struct stat *st) // the file record for a path
+{
+  file_t *f;
+  for (f = files; f; f = f->next) if (f->len == len && !memcmp(f->name, name, len)) break;
+  if (!f) {
+    f = (file_t *) new(sizeof(file_t));
+    f->name = new(len + 1); memcpy(f->name, name, len + 1); f->len = len;
+    f->next = files; files = f;
+  }
+  f->dev = st->st_dev; f->ino = st->st_ino;
+  return f;
+}
+
+int onced(file_t *f) // file already read and marked include once, by identity or by path when there is no inode
+{
+  file_t *o;
+  for (o = files; o; o = o->next)
+    if (o->once && (f->ino ? o->dev == f->dev && o->ino == f->ino : o == f)) return 1;
+  return 0;
+}
+
+void setonce() { fcur->once = 1; }
+
+int guarded(char *p) // text at p starts with #ifndef X / #define X, whether the #endif closing it ends the file is found while lexing
+{
+  char *q; int n;
+  for (;;) { // leading blank lines and comments
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '/' && p[1] == '/') p = skipto(p, '\n', '\n');
+    else if (*p == '/' && p[1] == '*') { for (p += 2; *(p = skipto(p, '*', '*')) && p[1] != '/'; p++); if (*p) p += 2; }
+    else break;
+  }
+  if (memcmp(p, "#ifndef", 7)) return 0;
+  for (q = skipws(p + 7), n = 0; idchar(q[n]); n++);
+  if (!n || !*(p = skipto(q + n, '\n', '\n'))) return 0;
+  p = skipws(p + 1);
+  if (memcmp(p, "#define", 7)) return 0;
+  p = skipws(p + 7);
+  return !memcmp(p, q, n) && !idchar(p[n]);
+}
+
+int guardend(char *p) // nothing but blanks and comments after the line at p
+{
+  for (p = skipto(p, '\n', '\n'); ; ) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    if (*p == '/' && p[1] == '/') p = skipto(p, '\n', '\n');
+    else if (*p == '/' && p[1] == '*') { for (p += 2; *(p = skipto(p, '*', '*')) && p[1] != '/'; p++); if (!*p) return 1; p += 2; }
+    else return !*p;
+  }
+}
+
+void hgrow() // double the identifier hash table and reinsert
+{
+  ident_t **o, *d; int i, j, n;
+  o = ht; n = o ? hmask + 1 : 0;
+  hmask = o ? 2 * n - 1 : HASH_SZ - 1;
+  ht = (ident_t **) new((hmask + 1) * sizeof(ident_t *));
+  memset(ht, 0, (hmask + 1) * sizeof(ident_t *));
+  for (i = 0; i < n; i++) {
+    if (!(d = o[i])) continue;
+    for (j = d->hash & hmask; ht[j]; j = (j + 1) & hmask);
+    ht[j] = d;
+  }
+}
+
 void next()
 {
-  char *p; int b; ident_t **hm;
+  char *p; int b; uint h;
   struct stat st;
-  static char iname[512], *ifile, *ipos; // XXX 512
-  static int iline;
-  static ident_t *ht[HASH_SZ];
+  static char iname[512], *ipos; // XXX 512
+  incl_t *in;
+  file_t *f;
 
   for (;;) {
     switch (tk = *pos++) {
-    case ' ': case '\t': case '\v': case '\r': case '\f':
+    case ' ': case '\t':
+      pos = skipws(pos);
+      continue;
+
+    case '\v': case '\r': case '\f':
       continue;
 
     case '\n':
       line++; if (debug) dline();
+      pos = skipws(pos);
       continue;
 
     case '#':
-      if (!memcmp(pos,"include",7)) {
-        if (ifile) { err("can't nest include files"); exit(-1); } // include errors bail out otherwise it gets messy
+      if (!memcmp(pos,"include",7)) { // include errors bail out otherwise it gets messy
         pos += 7;
         while (*pos == ' ' || *pos == '\t') pos++;
         if (*pos != '"' && *pos != '<') { err("bad include file name"); exit(-1); }
@@ -289,37 +405,52 @@ void next()
           if (stat(iname, &st)) { dprintf(2,"%s : [%s:%d] error: can't stat file %s\n", cmd, file, line, iname); exit(-1); }
         }
         while (*pos && *pos != '\n') pos++;
-        ipos = pos; pos = mapfile(iname, st.st_size);
-        ifile = file; file = iname;
-        iline = line; line = 1;
+        if (onced(f = fintern(iname, b, &st))) continue;
+        if (idepth >= INCL_MAX) { err("include nested too deeply"); exit(-1); }
+        if ((in = ifree)) ifree = in->next; else in = (incl_t *) new(sizeof(incl_t));
+        in->file = fcur; in->pos = pos; in->line = line;
+        in->gstate = gstate; in->gdepth = gdepth; in->gpos = gpos;
+        in->next = istk; istk = in; idepth++;
+        pos = mapfile(iname, st.st_size);
+        fcur = f; file = f->name;
+        gstate = guarded(pos); gdepth = 0;
+        line = 1;
         if (debug) dline();
         continue;
       }
+      if (!memcmp(pos,"pragma",6) && !memcmp(p = skipws(pos + 6),"once",4) && !idchar(p[4])) setonce();
+      if (gstate == 2) gstate = 0; // a directive after the guard closed
+      else if (gstate) {
+        p = skipws(pos);
+        if (!memcmp(p,"if",2)) gdepth++;
+        else if (!memcmp(p,"endif",5) && !--gdepth) { gstate = 2; gpos = p; }
+      }
       while (*pos && *pos != '\n') pos++;
       continue;
 
     case 'a' ... 'z': case 'A' ... 'Z': case '_': case '$':
       p = pos - 1;
+      h = (0x811c9dc5 ^ tk) * 16777619; // FNV-1a
       for (;;) {
         switch (*pos) {
         case 'a' ... 'z': case 'A' ... 'Z': case '0' ... '9': case '_': case '$':
-          tk = tk * 147 + *pos++;
+          h = (h ^ *pos++) * 16777619;
           continue;
         }
         break;
       }
-      id = *(hm = &ht[tk & (HASH_SZ - 1)]);
-      tk ^= (b = pos - p);
-      while (id) {
-        if (tk == id->hash && (b < 5 || !memcmp(id->name, p, b))) { tk = id->tk; return; } // b < 5 dependant on hash func and size
-        id = id->next;
-      }
-      id = (ident_t *) vp; vp += sizeof(ident_t);
+      h ^= h >> 16; // fold the well mixed high bits into the slot index
+      b = pos - p;
+      if (2 * hused >= hmask) hgrow();
+      for (tk = h & hmask; (id = ht[tk]); tk = (tk + 1) & hmask)
+        if (id->hash == h && id->len == b && !memcmp(id->name, p, b)) { tk = id->tk; return; }
+      if (idp == ide) { idp = (ident_t *) new(ID_SZ); ide = idp + ID_SZ / sizeof(ident_t); }
+      ht[tk] = id = idp++; hused++;
+      memset(id, 0, sizeof(ident_t));
       id->name = p;
-      id->hash = tk;
-      id->next = *hm;
+      id->hash = h;
+      id->len = b;
       tk = id->tk = Id;
-      *hm = id;
       return;
 
     case '0' ... '9':
@@ -359,12 +490,13 @@ frac:     b = 10;
 
     case '/':
       if (*pos == '/') { // single line comment
-        while (*++pos != '\n' && *pos);
+        pos = skipto(pos, '\n', '\n');
         continue;
       } else if (*pos == '*') { // comment
-        while (*++pos) {
+        pos++;
+        while (*(pos = skipto(pos, '*', '\n'))) {
           if (*pos == '*' && pos[1] == '/') { pos += 2; break; }
-          else if (*pos == '\n') { line++; if (debug) { pos++; dline(); pos--; } }
+          else if (*pos++ == '\n') { line++; if (debug) dline(); }
         }
         continue;
       }
@@ -374,7 +506,10 @@ frac:     b = 10;
 
     case '\'': case '"':
       ival = data;
-      while ((b = *pos++) != tk) {
+      for (;;) {
+        p = skipto(pos, tk, '\\'); // plain runs are copied whole
+        memcpy((char *)(gs + data), pos, p - pos); data += p - pos; pos = p;
+        if ((b = *pos++) == tk) break;
         if (b == '\\') {
           switch (b = *pos++) {
           case '\'': case '"': case '?': case '\\': break;
@@ -458,10 +593,11 @@ frac:     b = 10;
     case ')':
     case ']': return;
     case 0:
-      if (!ifile) { pos--; return; }
-      file = ifile; ifile = 0;
-      pos = ipos;
-      line = iline;
+      if (!(in = istk)) { pos--; return; }
+      if (gstate == 2 && guardend(gpos)) setonce(); // all of the file was inside the guard
+      gstate = in->gstate; gdepth = in->gdepth; gpos = in->gpos; idepth--;
+      fcur = in->file; file = fcur->name; pos = in->pos; line = in->line;
+      istk = in->next; in->next = ifree; ifree = in;
       continue;
 
     default: err("bad token"); continue;
@@ -714,6 +850,13 @@ void stmt();
 void node(int n, int *a, int *b);
 void cast(uint t);
 
+void mapsym(char *name, int addr) // "addr name" line for each function, em -y reads them back
+{
+  char *p = name;
+  while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9') || *p == '_' || *p == '$') p++;
+  dprintf(mapfd, "%08x %.*s\n", addr, p - name, name);
+}
+
 void decl(TOKEN bc)
 {
   int sc, size, align, hglo, *b, *c = 0; uint bt, t; ident_t *v; loc_t *sp;
@@ -735,13 +878,14 @@ void decl(TOKEN bc)
         rt = *(uint *)(va+(t>>TSHIFT));
         if (v->class == FFun) {
           patch(v->val,ip); ffun--;
-          if (rt != *(uint *)(va+(v->type>>TSHIFT)) || ((bt  = *(uint *)(va+(v->type>>TSHIFT)+4)) &&
-            bt != *(uint *)(va+(t>>TSHIFT)+4))) err("conflicting forward function declaration");
+          if (v != tmain && (rt != *(uint *)(va+(v->type>>TSHIFT)) || ((bt  = *(uint *)(va+(v->type>>TSHIFT)+4)) &&
+            bt != *(uint *)(va+(t>>TSHIFT)+4)))) err("conflicting forward function declaration");
         }
         else if (v->class) err("duplicate function definition");
         v->class = Fun;
         v->type = t;
         v->val = ip;
+        if (mapfd) mapsym(v->name, ip - ts);
         loc = 0;
         next();
         b = e;
@@ -764,10 +908,12 @@ void decl(TOKEN bc)
         break;
       } else if ((t & TMASK) == FUN) {
 //        if (bc != Static || sc != Static) err("bad nested function declaration");
-        if (v->class) err("duplicate function declaration");
+        if (v->class != FFun || v != tmain) {
+          if (v->class) err("duplicate function declaration");
+          ffun++;
+        }
         v->class = FFun;
         v->type = t;
-        ffun++;
         while (ploc != sp) {
           ploc--;
           v = ploc->id;
@@ -1051,7 +1197,7 @@ void expr(int lev)
     node(FFun,0,(int *)id);
     next();
     if (tk != Paren) err("undefined symbol");
-    else if (verbose) dprintf(2,"%s : [%s:%d] warning: undeclared function called here\n", cmd, file, line);
+    else if (verbose && id != tmain) dprintf(2,"%s : [%s:%d] warning: undeclared function called here\n", cmd, file, line);
     break;
 
   case Va_arg: // va_arg(list,mode) *(mode *)(list += 8)
@@ -2159,8 +2305,8 @@ void stmt()
 
 int main(int argc, char *argv[])
 {
-  int i, amain, text, *patchdata, *patchbss, sbrk_start;
-  ident_t *tmain;
+  int i, amain, entry, text, *patchdata, *patchbss, sbrk_start;
+  ident_t *tstart;
   char *outfile;
   struct { uint magic, bss, entry, flags; } hdr;
   struct stat st;
@@ -2173,9 +2319,14 @@ int main(int argc, char *argv[])
     switch (file[1]) {
     case 'v': verbose = 1; break;
     case 's': debug = 1; break;
+    case 'l': lexonly = 1; break;
     case 'I': incl = file + 2; break;
+    case 'm':
+      if (argc < 2) goto usage;
+      if ((mapfd = open(*++argv, O_WRONLY | O_CREAT | O_TRUNC)) < 0) { dprintf(2,"%s : error: can't open map file %s\n", cmd, *argv); return -1; }
+      argc--; break;
     case 'o': if (argc > 1) { outfile = *++argv; argc--; break; }
-    default: usage: dprintf(2,"usage: %s [-v] [-s] [-Ipath] [-o exefile] file ...\n", cmd); return -1;
+    default: usage: dprintf(2,"usage: %s [-v] [-s] [-l] [-Ipath] [-o exefile] [-m mapfile] file ...\n", cmd); return -1;
     }
     file = *++argv;
   }
@@ -2188,13 +2339,16 @@ int main(int argc, char *argv[])
   bigend = 1; bigend = ((char *)&bigend)[3];
 
   pos = "asm auto break case char continue default do double else enum float for goto if int long return short "
-        "sizeof static struct switch typedef union unsigned void while va_list va_start va_arg main";
+        "sizeof static struct switch typedef union unsigned void while va_list va_start va_arg main _start";
   for (i = Asm; i <= Va_arg; i++) { next(); id->tk = i; }
   next();
   tmain = id;
+  next();
+  tstart = id;
 
   line = 1;
   if (stat(file, &st)) { dprintf(2,"%s : [%s:%d] error: can't stat file %s\n", cmd, file, line, file); return -1; } // XXX fstat inside mapfile?
+  fcur = fintern(file, strlen(file), &st);
   pos = mapfile(file, st.st_size);
 
   e = new(EXPR_SZ) + EXPR_SZ;
@@ -2204,6 +2358,11 @@ int main(int argc, char *argv[])
 
   if (verbose) dprintf(2,"%s : compiling %s\n", cmd, file);
   if (debug) dline();
+  if (lexonly) {
+    for (i = 0; next(), tk; i++) data = 0; // string literals are not kept
+    dprintf(2,"%s : %s lexed %d bytes %d tokens\n", cmd, file, srcbytes, i);
+    return 0;
+  }
   next();
   decl(Static);
   if (!errs && ffun) err("unresolved forward function (retry with -v)");
@@ -2215,9 +2374,10 @@ int main(int argc, char *argv[])
 
   if (text + data + bss > SEG_SZ) err("text + data + bss segment exceeds maximum size");
   if (!(amain = tmain->val)) err("main() not defined");
+  entry = (tstart->class == Fun) ? tstart->val : amain; // libc's _start calls main then flushes stdio
 
   if (verbose || errs) dprintf(2,"%s : %s compiled with %d errors\n", cmd, file, errs);
-  if (verbose) dprintf(2,"entry = 0x%x text = 0x%x data = 0x%x bss = 0x%x\n", amain - ts, text, data, bss);
+  if (verbose) dprintf(2,"entry = 0x%x text = 0x%x data = 0x%x bss = 0x%x\n", entry - ts, text, data, bss);
 
   if (!errs && !debug) {
     while (pdata != patchdata) { pdata--; *(int *)*pdata += (ip        - *pdata - 4) << 8; }
@@ -2227,7 +2387,7 @@ int main(int argc, char *argv[])
         { dprintf(2,"%s : error: can't open output file %s\n", cmd, outfile); return -1; }
       hdr.magic = 0xC0DEF00D;
       hdr.bss   = bss;
-      hdr.entry = amain - ts;
+      hdr.entry = entry - ts;
       hdr.flags = 0;
       write(i, &hdr, sizeof(hdr));
       write(i, (void *) ts, text);
@@ -2238,7 +2398,7 @@ int main(int argc, char *argv[])
       sbrk(sbrk_start + text + data + 8 - (int)sbrk(0)); // free compiler memory
       sbrk(bss);
       if (verbose) dprintf(2,"%s : running %s\n", cmd, file);
-      errs = ((int (*)())amain)(argc, argv);
+      errs = ((int (*)())entry)(argc, argv);
       if (verbose) dprintf(2,"%s : %s main returned %d\n", cmd, file, errs);
     }
   }
@@ -1,6 +1,6 @@
 // em -- cpu emulator
 //
-// Usage:  em [-v] [-m memsize] [-f filesys] file
+// Usage:  em [-v] [-m memsize] [-f filesys] [-c costs] [-C caches] [-B branches] [-y symbols] [-s snapshots] [-u] file [args]
 //
 // Description:
 //
@@ -10,20 +10,30 @@
 #include <libc.h>
 #include <libm.h>
 #include <dir.h>
+#include <vec.h>
+#include <ops.h>
 
 enum {
   MEM_SZ = 128*1024*1024, // default memory size of virtual machine (128M)
   TB_SZ  =     1024*1024, // page translation buffer array size (4G / pagesize)
   FS_SZ  =   4*1024*1024, // ram file system size (4M)
   TPAGES = 4096,          // maximum cached page translations
+  PDC    = 16,            // cached page directory entries
+  PCS    = 64*1024,       // cache and branch model per pc table size
+  USTK_SZ = 8*1024*1024,  // stack kept clear of the heap in user mode emulation
 };
 
+enum { BIMODAL = 1, GSHARE }; // branch direction predictors
+
+enum { DBASE = 1, DSNAP = 2 }; // dirty page bits: written since the baseline, since the last snapshot
+
 enum {           // page table entry flags
   PTE_P = 0x001, // Present
   PTE_W = 0x002, // Writeable
   PTE_U = 0x004, // User
   PTE_A = 0x020, // Accessed
   PTE_D = 0x040, // Dirty
+  PTE_PS = 0x080, // Page size, a page directory entry mapping 4M
 };
 
 enum {           // processor fault codes (some can be masked together)
@@ -37,25 +47,68 @@ enum {           // processor fault codes (some can be masked together)
   FIPAGE,        // page fault on opcode fetch
   FWPAGE,        // page fault on write
   FRPAGE,        // page fault on read
+  FCLOCK,        // real time timer interrupt
   USER = 16      // user mode exception
 };
 
+enum { // interrupt controller registers, operand of ICR/ICW
+  IC_CTRL,       // bit 0 enables vectors, priorities, masking and in service tracking
+  IC_MASK,       // masked interrupt causes, 1 << cause
+  IC_PEND,       // pending interrupt causes (ipend)
+  IC_ISR,        // interrupt causes in service
+  IC_EOI,        // write to end the highest priority interrupt in service
+  IC_VEC = 16,   // + cause: handler address, 0 for ivec
+  IC_PRI = 32,   // + cause: priority, higher preempts lower
+  IC_END = 48
+};
+
 uint verbose,    // chatty option -v
   memory, memorySize,    // physical memory
   user,          // user mode
   iena,          // interrupt enable
-  ipend,         // interrupt pending
+  ipend,         // interrupt pending, 1 << cause
+  icctl, icmask, icisr, icvec[16], icpri[16], // interrupt controller
   trap,          // fault code
   ivec,          // interrupt vector
+  svec,          // system call vector
+  sysno,         // number of the last fast system call
+  bank,          // user entry vector, banked registers on when non-zero
+  ubank[3], kbank[3], // a, b, c of the register bank not in use
+  clkhi,         // high word of the last CLK 1
   vadr,          // bad virtual address
   virtualMemoryEnabled,        // virtual memory enabled
   pageDirectory,          // page directory
   tpage[TPAGES], // valid page translations
   tpages,        // number of cached page translations
+  pdctag[PDC], pdcpde[PDC], pdcp[PDC], pdcpt[PDC], // page walk cache: (v >> 22) + 1, present entry, its host address, host address of its page table
   *kernelReadPageTable, *kernelWritePageTable,    // kernel read/write page transation tables
   *userReadPageTable, *userWritePageTable,    // user read/write page transation tables
   *currentReadPageTable,  *currentWritePageTable;     // current read/write page transation tables
 
+uint *costs,     // cost model: extra cycles per opcode times 4, 0 when off
+  bshift = 3,    // block memory instructions cost a cycle per 1 << bshift bytes
+  tlbcost,       // cycles for filling a page translation
+  walkcost,      // cycles for reading a page directory entry
+  stall;         // translation cycles not yet moved into the cycle count
+
+struct cache { uint sets, ways, shift, *tag, acc, miss; } l1i, l1d, l2; // tags + 1, most recently used first
+struct pcstat { uint pc, n, im, da, dm, l2m, br, tk, bm, tm; } *pcs; // pc + 1, fetches, L1i misses, data lines, L1d misses, L2 misses,
+                                                         // branches, taken, direction and target mispredicts
+uint pcsused, nsyms, *symaddr; char **symname; // function symbols from c -m, by address
+uint bkind, bents, hbits, ghr, btbents, *btbtag, *btbtgt, bcond, bind, bdmiss, btmiss; uchar *bctr; // branch model
+
+uint hostsys,   // user mode emulation -u, system calls done on the host
+  ubrk, ubrk0, ubrkmax, // program break, where it starts and how far it may grow
+  uring;         // registered system call ring
+
+uchar *dirty;    // dirty page bits per physical page, 0 until SNAP sets a baseline
+uint *dlist, dpages; // pages written since the baseline
+char *base;      // baseline memory image
+uint snappc, snapsp; // where a reset resumes
+int snapfd;      // incremental snapshot file -s, -1 when none
+
+long long rtbase, rtdue, rtperiod; // host time at start, next real time timer deadline and period, ns
+
 char *cmd;       // command name
 
 static int dbg;  // debugger enable flag
@@ -68,6 +121,36 @@ void *new(int size)
   return (void *)(((int)p + 7) & -8);
 }
 
+void *zalloc(int size) // zeroed memory whose pages are only brought in when first touched
+{
+  void *p;
+  if ((p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)) == MAP_FAILED) {
+    dprintf(2,"%s : fatal: unable to mmap(%d)\n", cmd, size); exit(-1);
+  }
+  return p;
+}
+
+long long nsec() // host monotonic time since start
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec - rtbase;
+}
+
+uint rtexpired() // real time timer due, set up the next period
+{
+  long long t;
+  if (!rtdue || (t = nsec()) < rtdue) return 0;
+  rtdue = rtperiod ? (rtdue + rtperiod > t ? rtdue + rtperiod : t + rtperiod) : 0; // a late period is not made up
+  return 1;
+}
+
+int rtwait() // ms until the real time timer is due, 0 once it is, as a poll timeout
+{
+  long long t = rtdue - nsec();
+  return t > 0 ? (int)((t + 999999) / 1000000) : 0;
+}
+
 void flush()
 {
   uint v;
@@ -77,6 +160,7 @@ void flush()
     v = tpage[--tpages];
     kernelReadPageTable[v] = kernelWritePageTable[v] = userReadPageTable[v] = userWritePageTable[v] = 0;
   }
+  memset(pdctag, 0, sizeof(pdctag));
 }
 
 uint setpage(uint v, uint p, uint writable, uint userable)
@@ -87,6 +171,7 @@ uint setpage(uint v, uint p, uint writable, uint userable)
     if (tpages >= TPAGES) flush();
     tpage[tpages++] = v;
   }
+  stall += tlbcost;
 //  if (verbose) printf(".");
   kernelReadPageTable[v] = p;
   kernelWritePageTable[v] = writable ? p : 0;
@@ -95,20 +180,45 @@ uint setpage(uint v, uint p, uint writable, uint userable)
   return p;
 }
 
-uint rlook(uint v)
+void mark(uint i) // physical page i written
 {
-  uint pde, *ppde, pte, *ppte, q, userable;
-//  dprintf(2,"rlook(%08x)\n",v);
-  if (!virtualMemoryEnabled) return setpage(v, v, 1, 1);
+  if (!(dirty[i] & DBASE) && i < memorySize >> 12) dlist[dpages++] = i;
+  dirty[i] = DBASE | DSNAP;
+}
+
+void touch(uint h, uint n) // n bytes at host address h of memory written by em itself, not through a write translation
+{
+  uint i;
+  if (dirty && n) for (i = (h - memory) >> 12; i <= (h + n - 1 - memory) >> 12; i++) mark(i);
+}
+
+uint pdlook(uint v, uint fault) // page walk cache slot + 1 holding the page directory entry for v, 0 on a fault
+{
+  uint i, pde, *ppde;
+  if (pdctag[i = (v >> 22) & (PDC - 1)] == (v >> 22) + 1) return i + 1;
+  stall += walkcost;
   pde = *(ppde = (uint *)(pageDirectory + (v>>22<<2))); // page directory entry
-  if (pde & PTE_P) {
-    if (!(pde & PTE_A)) *ppde = pde | PTE_A;
+  if (!(pde & PTE_P)) { trap = fault; vadr = v; return 0; } // only present entries are cached, filling one needs no flush
+  if (!(pde & PTE_A)) { *ppde = pde |= PTE_A; touch((uint)ppde, 4); }
+  if (!(pde & PTE_PS)) {
     if (pde >= memorySize) { trap = FMEM; vadr = v; return 0; }
-    pte = *(ppte = (uint *)(memory + (pde & -4096) + ((v >> 10) & 0xffc))); // page table entry
-    if ((pte & PTE_P) && ((userable = (q = pte & pde) & PTE_U) || !user)) {
-      if (!(pte & PTE_A)) *ppte = pte | PTE_A;
-      return setpage(v, pte, (pte & PTE_D) && (q & PTE_W), userable); // set writable after first write so dirty gets set
-    }
+    pdcpt[i] = memory + (pde & -4096);
+  }
+  pdctag[i] = (v >> 22) + 1; pdcpde[i] = pde; pdcp[i] = (uint)ppde;
+  return i + 1;
+}
+
+uint rlook(uint v)
+{
+  uint i, pte, *ppte, q, userable;
+//  dprintf(2,"rlook(%08x)\n",v);
+  if (!virtualMemoryEnabled) return setpage(v, v, !dirty || dirty[v >> 12] == (DBASE | DSNAP), 1); // with dirty tracking on the first write has to come through wlook
+  if (!(i = pdlook(v, FRPAGE))) return 0;
+  if (pdcpde[--i] & PTE_PS) pte = (pdcpde[i] & 0xffc00fff) | (v & 0x3ff000), ppte = (uint *)pdcp[i]; // 4M page, no page table
+  else pte = *(ppte = (uint *)(pdcpt[i] + ((v >> 10) & 0xffc))); // page table entry
+  if ((pte & PTE_P) && ((userable = (q = pte & pdcpde[i]) & PTE_U) || !user)) {
+    if (!(pte & PTE_A)) { *ppte |= PTE_A; touch((uint)ppte, 4); }
+    return setpage(v, pte, (pte & PTE_D) && (q & PTE_W) && (!dirty || dirty[pte >> 12] == (DBASE | DSNAP)), userable); // set writable after first write so dirty gets set
   }
   trap = FRPAGE;
   vadr = v;
@@ -117,24 +227,420 @@ uint rlook(uint v)
 
 uint wlook(uint v)
 {
-  uint pde, *ppde, pte, *ppte, q, userable;
+  uint i, pte, *ppte, q, userable;
 //  dprintf(2,"wlook(%08x)\n",v);
-  if (!virtualMemoryEnabled) return setpage(v, v, 1, 1);
-  pde = *(ppde = (uint *)(pageDirectory + (v>>22<<2))); // page directory entry
-  if (pde & PTE_P) {
-    if (!(pde & PTE_A)) *ppde = pde | PTE_A;
-    if (pde >= memorySize) { trap = FMEM; vadr = v; return 0; }
-    pte = *(ppte = (uint *)(memory + (pde & -4096) + ((v >> 10) & 0xffc)));  // page table entry
-    if ((pte & PTE_P) && (((userable = (q = pte & pde) & PTE_U) || !user) && (q & PTE_W))) {
-      if ((pte & (PTE_D | PTE_A)) != (PTE_D | PTE_A)) *ppte = pte | (PTE_D | PTE_A);
-      return setpage(v, pte, q & PTE_W, userable);
-    }
+  if (!virtualMemoryEnabled) { if (dirty) mark(v >> 12); return setpage(v, v, 1, 1); }
+  if (!(i = pdlook(v, FWPAGE))) return 0;
+  if (pdcpde[--i] & PTE_PS) pte = (pdcpde[i] & 0xffc00fff) | (v & 0x3ff000), ppte = (uint *)pdcp[i]; // 4M page, no page table
+  else pte = *(ppte = (uint *)(pdcpt[i] + ((v >> 10) & 0xffc)));  // page table entry
+  if ((pte & PTE_P) && (((userable = (q = pte & pdcpde[i]) & PTE_U) || !user) && (q & PTE_W))) {
+    if ((pte & (PTE_D | PTE_A)) != (PTE_D | PTE_A)) { *ppte |= PTE_D | PTE_A; touch((uint)ppte, 4); if (ppte == (uint *)pdcp[i]) pdcpde[i] |= PTE_D; }
+    if (dirty) mark(pte >> 12);
+    return setpage(v, pte, q & PTE_W, userable);
   }
   trap = FWPAGE;
   vadr = v;
   return 0;
 }
 
+// dirty page tracking -- with a baseline set, the first write to a physical page after a flush goes
+// through wlook, which marks it.  Later writes hit the write translation and cost nothing.  Taking
+// a baseline or snapshot or resetting clears the bits and flushes, so the next write marks again.
+uint snapwrite(uint all) // append the pages written since the last snapshot to the -s file (all that are not zero when all is set), returns how many
+{
+  uint i, j, n, *w, end = -1;
+  if (snapfd < 0) return -1;
+  for (n = i = 0; i < memorySize >> 12; i++) {
+    w = (uint *)(memory + (i << 12));
+    if (all) { for (j = 0; j < 1024 && !w[j]; j++); if (j == 1024) continue; }
+    else if (!(dirty[i] & DSNAP)) continue;
+    j = i << 12;
+    if (write(snapfd, &j, 4) != 4 || write(snapfd, w, 4096) != 4096) { dprintf(2,"%s : snapshot write failed\n", cmd); exit(-1); }
+    dirty[i] &= ~DSNAP;
+    n++;
+  }
+  write(snapfd, &end, 4);
+  return n;
+}
+
+uint snapbase() // memory as it is becomes the baseline, returns the pages copied
+{
+  uint i, n;
+  if (!dirty) {
+    dirty = (uchar *) zalloc(TB_SZ);
+    dlist = (uint *) new((memorySize >> 12) * sizeof(uint));
+    base = (char *) new(memorySize);
+    memcpy(base, (char *)memory, memorySize);
+    snapwrite(1);
+    return memorySize >> 12;
+  }
+  for (n = 0; n < dpages; n++) {
+    i = dlist[n];
+    memcpy(base + (i << 12), (char *)(memory + (i << 12)), 4096);
+    dirty[i] &= ~DBASE;
+  }
+  dpages = 0;
+  return n;
+}
+
+uint snapreset() // put the pages written since the baseline back, returns how many
+{
+  uint i, n;
+  for (n = 0; n < dpages; n++) {
+    i = dlist[n];
+    memcpy((char *)(memory + (i << 12)), base + (i << 12), 4096);
+    dirty[i] = DSNAP;
+  }
+  dpages = 0;
+  return n;
+}
+
+void vec(int op, int bytes, char *d, char *s, uint n) // packed vector op over n bytes of word or byte lanes
+{
+  switch (op) {
+  case VADD: if (bytes) vadd8(d, s, n); else vadd32(d, s, n); return;
+  case VXOR: vxor(d, s, n); return;
+  case VAND: vand(d, s, n); return;
+  case VCEQ: if (bytes) vceq8(d, s, n); else vceq32(d, s, n); return;
+  case VMN: if (bytes) vmin8(d, s, n); else vmin32(d, s, n); return;
+  case VMX: if (bytes) vmax8(d, s, n); else vmax32(d, s, n); return;
+  }
+}
+
+// per pc profile shared by the cache and branch models, with function names from c -m
+struct pcstat *pcprof(uint pc)
+{
+  struct pcstat *s;
+  for (s = pcs + ((pc >> 2) * 2654435761U >> 16) % PCS; s->pc != pc + 1; s = (s == pcs + PCS - 1) ? pcs : s + 1) {
+    if (s->pc) continue;
+    if (pcsused >= PCS - 1) return pcs + PCS; // full, the overflow entry
+    pcsused++; s->pc = pc + 1; break;
+  }
+  return s;
+}
+
+void pcprofinit()
+{
+  if (pcs) return;
+  pcs = (struct pcstat *) new((PCS + 1) * sizeof(struct pcstat));
+  memset(pcs, 0, (PCS + 1) * sizeof(struct pcstat));
+}
+
+void loadsyms(char *file) // "addr name" lines from c -m, in address order
+{
+  int f, i; char *s, *e; struct stat st;
+  if ((f = open(file, O_RDONLY)) < 0) { dprintf(2,"%s : couldn't open symbol file %s\n", cmd, file); exit(-1); }
+  if (fstat(f, &st)) { dprintf(2,"%s : couldn't stat symbol file %s\n", cmd, file); exit(-1); }
+  s = new(st.st_size + 1);
+  if (read(f, s, st.st_size) != st.st_size) { dprintf(2,"%s : failed to read symbol file %s\n", cmd, file); exit(-1); }
+  close(f);
+  e = s + st.st_size; *e = 0;
+  for (i = 0, f = 0; f < st.st_size; f++) if (s[f] == '\n') i++;
+  symaddr = (uint *) new((i + 1) * sizeof(uint));
+  symname = (char **) new((i + 1) * sizeof(char *));
+  while (s < e) {
+    symaddr[nsyms] = strtoul(s, &s, 16);
+    while (*s == ' ') s++;
+    symname[nsyms++] = s;
+    while (s < e && *s != '\n') s++;
+    *s++ = 0;
+  }
+}
+
+char *symbol(uint pc) // function holding pc, "?" when there is none
+{
+  uint lo, hi, m;
+  if (!nsyms || pc < symaddr[0]) return "?";
+  for (lo = 0, hi = nsyms; hi - lo > 1; ) if (symaddr[m = (lo + hi) / 2] <= pc) lo = m; else hi = m;
+  return symname[lo];
+}
+
+struct pcstat *pcsort(uint *n, int byfunc, int (*cmp)(const void *, const void *)) // sorted copy of the used entries, pc holds the function name when byfunc
+{
+  struct pcstat *r, *s, *t; uint i;
+  r = (struct pcstat *) new(pcsused * sizeof(struct pcstat) + sizeof(struct pcstat));
+  for (s = pcs, t = r; s < pcs + PCS; s++) {
+    if (!s->pc) continue;
+    *t = *s;
+    if (byfunc) {
+      t->pc = (uint)symbol(s->pc - 1);
+      for (i = 0; i < t - r && r[i].pc != t->pc; i++);
+      if (i < t - r) {
+        r[i].n += s->n; r[i].im += s->im; r[i].da += s->da; r[i].dm += s->dm; r[i].l2m += s->l2m;
+        r[i].br += s->br; r[i].tk += s->tk; r[i].bm += s->bm; r[i].tm += s->tm;
+        continue;
+      }
+    }
+    t++;
+  }
+  qsort(r, *n = t - r, sizeof(struct pcstat), cmp);
+  return r;
+}
+
+// cache model -- virtually indexed, write allocate, LRU
+uint cacheref(struct cache *c, uint v) // 1 on a miss, the line then replaces the least recently used one
+{
+  uint *t, l, i, m;
+  c->acc++;
+  l = (v >> c->shift) + 1;
+  t = c->tag + ((l - 1) & (c->sets - 1)) * c->ways;
+  for (i = 0; i < c->ways - 1 && t[i] != l; i++);
+  c->miss += (m = t[i] != l);
+  memmove(t + 1, t, i * sizeof(uint)); t[0] = l;
+  return m;
+}
+
+void cachedata(struct pcstat *s, uint v, uint n) // n bytes at v, line by line
+{
+  uint l, e;
+  if (!n) return;
+  for (l = v >> l1d.shift, e = (v + n - 1) >> l1d.shift; ; l++) {
+    s->da++;
+    if (cacheref(&l1d, l << l1d.shift)) { s->dm++; s->l2m += cacheref(&l2, l << l1d.shift); }
+    if (l == e) return;
+  }
+}
+
+void cacheinsn(uint pc, int ir, uint a, uint b, uint sp) // fetch and the data line of the instruction at pc, block instructions count their own
+{
+  struct pcstat *s; uint op;
+  s = pcprof(pc);
+  s->n++;
+  if (cacheref(&l1i, pc)) { s->im++; s->l2m += cacheref(&l2, pc); }
+  op = (uchar)ir;
+  if ((op >= LL && op <= LLF) || (op >= LBL && op <= LBLF) || (op >= SL && op <= SLF) || op == LEV || op == LCL) cachedata(s, sp + (ir >> 8), 1);
+  else if ((op >= LG && op <= LGF) || (op >= LBG && op <= LBGF) || (op >= SG && op <= SGF)) cachedata(s, pc + 4 + (ir >> 8), 1);
+  else if (op >= LX && op <= LXF) cachedata(s, a + (ir >> 8), 1);
+  else if ((op >= LBX && op <= LBXF) || (op >= SX && op <= SXF)) cachedata(s, b + (ir >> 8), 1);
+  else if (op == PSHA || op == PSHB || op == PSHC || op == PSHF || op == PSHG || op == PSHI || op == JSR || op == JSRA) cachedata(s, sp - 8, 1);
+  else if (op == POPA || op == POPB || op == POPC || op == POPF || op == POPG) cachedata(s, sp, 1);
+  else if (op == RTI) cachedata(s, sp, 16); // SYSC, SYSR and trap frames are counted where they are pushed
+}
+
+void cacheinit(char *spec) // sets:ways:line for L1i, L1d and L2, comma separated, later ones may be left out ("-" for all defaults)
+{
+  struct cache *c[3]; uint i, j, n[3];
+  c[0] = &l1i; c[1] = &l1d; c[2] = &l2;
+  l1i.sets = 64;   l1i.ways = 4; l1i.shift = 6; // 16K
+  l1d.sets = 64;   l1d.ways = 8; l1d.shift = 6; // 32K
+  l2.sets  = 1024; l2.ways  = 8; l2.shift  = 6; // 512K
+  for (j = 0; *spec >= '0' && *spec <= '9' && j < 3; j++) {
+    for (i = 0; i < 3; i++) { n[i] = atoi(spec); while (*spec >= '0' && *spec <= '9') spec++; if (*spec == ':') spec++; }
+    if (*spec == ',') spec++;
+    if (!n[0] || (n[0] & (n[0] - 1)) || !n[1] || n[1] > 64 || n[2] < 4 || (n[2] & (n[2] - 1))) {
+      dprintf(2,"%s : bad cache sets:ways:line %u:%u:%u (sets and line must be powers of 2)\n", cmd, n[0], n[1], n[2]); exit(-1);
+    }
+    c[j]->sets = n[0]; c[j]->ways = n[1];
+    for (c[j]->shift = 0; (1 << c[j]->shift) < n[2]; c[j]->shift++);
+  }
+  if (l1d.shift != l2.shift) { dprintf(2,"%s : L1d and L2 need the same line size\n", cmd); exit(-1); }
+  for (j = 0; j < 3; j++) {
+    c[j]->tag = (uint *) new(c[j]->sets * c[j]->ways * sizeof(uint));
+    memset(c[j]->tag, 0, c[j]->sets * c[j]->ways * sizeof(uint));
+  }
+  pcprofinit();
+}
+
+int bycachemisses(const void *x, const void *y)
+{
+  const struct pcstat *p = x, *q = y;
+  return (int)(q->im + q->dm - p->im - p->dm);
+}
+
+void cachereport()
+{
+  struct pcstat *r; uint i, n;
+  dprintf(2,"cache   sets ways line    accesses      misses   rate\n");
+  dprintf(2,"L1i   %6u %4u %4u %11u %11u %5.2f%%\n", l1i.sets, l1i.ways, 1 << l1i.shift, l1i.acc, l1i.miss, l1i.acc ? 100.0 * l1i.miss / l1i.acc : 0.0);
+  dprintf(2,"L1d   %6u %4u %4u %11u %11u %5.2f%%\n", l1d.sets, l1d.ways, 1 << l1d.shift, l1d.acc, l1d.miss, l1d.acc ? 100.0 * l1d.miss / l1d.acc : 0.0);
+  dprintf(2,"L2    %6u %4u %4u %11u %11u %5.2f%%\n", l2.sets, l2.ways, 1 << l2.shift, l2.acc, l2.miss, l2.acc ? 100.0 * l2.miss / l2.acc : 0.0);
+  if (pcs[PCS].n) dprintf(2,"(%u fetches past the %u pc table entries not broken down)\n", pcs[PCS].n, PCS);
+
+  r = pcsort(&n, 0, bycachemisses);
+  dprintf(2,"\npc       function              fetches  L1i miss   data lines  L1d miss  L2 miss\n");
+  for (i = 0; i < n && i < 20 && r[i].im + r[i].dm; i++)
+    dprintf(2,"%08x %-18.18s %10u %9u %12u %9u %8u\n", r[i].pc - 1, symbol(r[i].pc - 1), r[i].n, r[i].im, r[i].da, r[i].dm, r[i].l2m);
+
+  if (!nsyms) return;
+  r = pcsort(&n, 1, bycachemisses);
+  dprintf(2,"\nfunction                     fetches  L1i miss   data lines  L1d miss  L2 miss\n");
+  for (i = 0; i < n && i < 20 && r[i].im + r[i].dm; i++)
+    dprintf(2,"%-27.27s %10u %9u %12u %9u %8u\n", (char *)r[i].pc, r[i].n, r[i].im, r[i].da, r[i].dm, r[i].l2m);
+}
+
+// branch model -- 2 bit counters indexed by pc (bimodal) or by pc ^ global history (gshare), direct mapped btb
+void branchinit(char *spec) // bimodal:counters or gshare:counters:history bits, and btb:entries, comma separated ("-" for defaults)
+{
+  bkind = GSHARE; bents = 4096; hbits = 12; btbents = 1024;
+  while (*spec && *spec != '-') {
+    if (!memcmp(spec, "bimodal:", 8)) { bkind = BIMODAL; bents = strtoul(spec + 8, &spec, 10); }
+    else if (!memcmp(spec, "gshare:", 7)) { bkind = GSHARE; bents = strtoul(spec + 7, &spec, 10); if (*spec == ':') hbits = strtoul(spec + 1, &spec, 10); }
+    else if (!memcmp(spec, "btb:", 4)) btbents = strtoul(spec + 4, &spec, 10);
+    else { dprintf(2,"%s : bad branch model %s\n", cmd, spec); exit(-1); }
+    if (*spec == ',') spec++;
+  }
+  if (!bents || (bents & (bents - 1)) || !btbents || (btbents & (btbents - 1)) || hbits > 30) {
+    dprintf(2,"%s : branch counters and btb entries must be powers of 2\n", cmd); exit(-1);
+  }
+  bctr = (uchar *) new(bents); memset(bctr, 1, bents); // weakly not taken
+  btbtag = (uint *) new(btbents * sizeof(uint)); memset(btbtag, 0, btbents * sizeof(uint));
+  btbtgt = (uint *) new(btbents * sizeof(uint));
+  pcprofinit();
+}
+
+void branchinsn(uint pc, int ir, uint a, uint b, double f, double g) // predict the branch at pc before it runs
+{
+  struct pcstat *s; uint op, tk, tgt, i, p, v;
+  tk = 1;
+  switch (op = (uchar)ir) {
+  case BZ:   tk = !a; break;
+  case BZF:  tk = !f; break;
+  case BNZ:  tk = a != 0; break;
+  case BNZF: tk = f != 0; break;
+  case BE:   tk = a == b; break;
+  case BEF:  tk = f == g; break;
+  case BNE:  tk = a != b; break;
+  case BNEF: tk = f != g; break;
+  case BLT:  tk = (int)a < (int)b; break;
+  case BLTU: tk = a < b; break;
+  case BLTF: tk = f < g; break;
+  case BGE:  tk = (int)a >= (int)b; break;
+  case BGEU: tk = a >= b; break;
+  case BGEF: tk = f >= g; break;
+  case JSRA: tgt = a; break;
+  case JMPI: // target from the jump table, left out until the table page is mapped
+    if (!(p = currentReadPageTable[(v = pc + 4 + (ir >> 8) + (a << 2)) >> 12])) return;
+    tgt = pc + 4 + *(uint *)((v ^ p) & -4); break;
+  default: return;
+  }
+  s = pcprof(pc);
+  s->br++; s->tk += tk;
+  if (op == JSRA || op == JMPI) bind++;
+  else {
+    bcond++;
+    tgt = pc + 4 + (ir >> 10 << 2);
+    i = ((pc >> 2) ^ ghr) & (bents - 1);
+    if ((bctr[i] >> 1) != tk) { s->bm++; bdmiss++; }
+    if (tk) { if (bctr[i] < 3) bctr[i]++; } else if (bctr[i]) bctr[i]--;
+    if (bkind == GSHARE) ghr = (ghr << 1 | tk) & ((1 << hbits) - 1);
+    if (!tk) return;
+  }
+  i = (pc >> 2) & (btbents - 1);
+  if (btbtag[i] != pc + 1 || btbtgt[i] != tgt) { s->tm++; btmiss++; btbtag[i] = pc + 1; btbtgt[i] = tgt; }
+}
+
+int bybranchmisses(const void *x, const void *y)
+{
+  const struct pcstat *p = x, *q = y;
+  return (int)(q->bm + q->tm - p->bm - p->tm);
+}
+
+void branchreport()
+{
+  struct pcstat *r; uint i, n;
+  if (bkind == GSHARE) dprintf(2,"\ngshare %u counters %u history bits, btb %u entries\n", bents, hbits, btbents);
+  else dprintf(2,"\nbimodal %u counters, btb %u entries\n", bents, btbents);
+  dprintf(2,"conditional branches %11u  mispredicted %11u %5.2f%%\n", bcond, bdmiss, bcond ? 100.0 * bdmiss / bcond : 0.0);
+  dprintf(2,"indirect jumps       %11u\n", bind);
+  dprintf(2,"taken, btb missed    %11u\n", btmiss);
+  if (pcs[PCS].br) dprintf(2,"(%u branches past the %u pc table entries not broken down)\n", pcs[PCS].br, PCS);
+
+  r = pcsort(&n, 0, bybranchmisses);
+  dprintf(2,"\npc       function                 runs    taken  mispredict   rate  btb miss\n");
+  for (i = 0; i < n && i < 20 && r[i].bm + r[i].tm; i++)
+    dprintf(2,"%08x %-18.18s %9u %8u %11u %5.1f%% %9u\n", r[i].pc - 1, symbol(r[i].pc - 1), r[i].br, r[i].tk, r[i].bm, 100.0 * r[i].bm / r[i].br, r[i].tm);
+
+  if (!nsyms) return;
+  r = pcsort(&n, 1, bybranchmisses);
+  dprintf(2,"\nfunction                        runs    taken  mispredict   rate  btb miss\n");
+  for (i = 0; i < n && i < 20 && r[i].bm + r[i].tm; i++)
+    dprintf(2,"%-27.27s %9u %8u %11u %5.1f%% %9u\n", (char *)r[i].pc, r[i].br, r[i].tk, r[i].bm, 100.0 * r[i].bm / r[i].br, r[i].tm);
+}
+
+// user mode emulation -- a program runs without a kernel and its TRAP and SYSC system calls are done
+// on the host through the fd table of linux/libc.h.  It runs in kernel mode with paging off, so a
+// guest address is an offset into memory.
+char *guest(uint v, uint n) // host address of n bytes at v, 0 when they are not all in memory
+{
+  if (v >= memorySize || n > memorySize - v) return 0;
+  touch(memory + v, n); // counted as written, for write() needlessly
+  return (char *)(memory + v);
+}
+
+char *gstr(uint v) // host address of the string at v, 0 when it runs off the end of memory
+{
+  return (v < memorySize && memchr((char *)(memory + v), 0, memorySize - v)) ? (char *)(memory + v) : 0;
+}
+
+int hostring();
+
+int hostcall(uint n, uint a, uint b, uint c) // S_exit is left to the caller
+{
+  char *p;
+  switch (n) {
+  case S_write:  return (p = guest(b, c)) ? write(a, p, c) : -1;
+  case S_read:   return (p = guest(b, c)) ? read(a, p, c) : -1;
+  case S_open:   return (p = gstr(a)) ? open(p, (b & 3) | ((b & 0x100) ? O_CREAT : 0) | ((b & 0x200) ? O_TRUNC : 0)) : -1; // O_CREAT and O_TRUNC of lib/libc.h
+  case S_close:  return close(a);
+  case S_fstat:  return (p = guest(b, sizeof(struct stat))) ? fstat(a, (struct stat *)p) : -1;
+  case S_lseek:  return lseek(a, b, c);
+  case S_unlink: return (p = gstr(a)) ? unlink(p) : -1;
+  case S_mkdir:  return (p = gstr(a)) ? mkdir(p) : -1;
+  case S_chdir:  return (p = gstr(a)) ? chdir(p) : -1;
+  case S_sbrk:   // the heap has to be guest memory, so xsbrk's host malloc is no use here
+    if ((int)a < 0 ? ubrk - ubrk0 < -a : ubrkmax - ubrk < a) return -1;
+    if ((int)a < 0) memset((char *)(memory + ubrk + a), 0, -a); // memory handed out again reads as zero
+    ubrk += a;
+    return ubrk - a;
+  case S_getpid: return 1;
+  case S_sleep:  poll(0, 0, a); return 0;
+  case S_uptime: return nsec() / 1000000;
+  case S_ringsetup: if (!guest(a, sizeof(struct ring))) return -1; uring = a; return 0;
+  case S_ringenter: return hostring();
+  default:       return -1;
+  }
+}
+
+int hostring() // run queued calls as os4's sys_ringenter does
+{
+  struct ring *r; struct sqe *e; struct cqe *q; uint h, t;
+  if (!uring) return -1;
+  r = (struct ring *)(memory + uring);
+  touch((uint)r, sizeof(struct ring));
+  for (h = r->sq_head, t = r->cq_tail; h != r->sq_tail && t - r->cq_head < RING_SZ; h++, t++) {
+    e = &r->sq[h & (RING_SZ - 1)];
+    q = &r->cq[t & (RING_SZ - 1)];
+    q->res = (e->op == S_exit || e->op == S_ringenter) ? -1 : hostcall(e->op, e->a, e->b, e->c);
+    q->tag = e->tag;
+  }
+  t = h - r->sq_head;
+  r->sq_head = h;
+  r->cq_tail += t;
+  return t;
+}
+
+uint hostargs(int argc, char **argv, uint end) // main's return stub, argc and argv at the top of memory, the heap after end; returns the stack pointer
+{
+  uint s, p, *w; int i, n;
+  for (n = i = 0; i < argc; i++) n += strlen(argv[i]) + 1;
+  s = (memorySize - n - (argc + 3) * 4) & -8;
+  w = (uint *)(memory + s);
+  w[0] = S_exit << 8 | SYSC; // a main entered directly returns here with its exit status in a, libc's _start flushes stdio before it returns here
+  w[1] = HALT;
+  for (p = s + (argc + 3) * 4, i = 0; i < argc; i++, p += n) {
+    w[i + 2] = p;
+    memcpy((char *)(memory + p), argv[i], n = strlen(argv[i]) + 1);
+  }
+  w[argc + 2] = 0;
+  ubrk = ubrk0 = (end + 7) & -8;
+  ubrkmax = s - USTK_SZ;
+  if (ubrkmax < ubrk0) { dprintf(2,"%s : no memory left for the stack\n", cmd); exit(-1); }
+  s -= 24;
+  w = (uint *)(memory + s);
+  w[0] = s + 24; w[2] = argc; w[4] = s + 32; // return address, argc, argv
+  return s;
+}
+
 static char dbg_getcmd(char *buf)
 {
   char c;
@@ -178,6 +684,34 @@ static char *DBG_REG_CONTEX = "\n"
         "vmem:\t%x\t\t[virtual memory enabled or not]\n\n"
         "ipend:\t%8.8x\t[interrupted pending or not]\n\n";
 
+// take the next pending interrupt, 0 if none can be delivered.  With the controller off the lowest
+// numbered cause goes first.  With it on, the highest priority unmasked cause goes first, but only
+// if it outranks everything in service, and it is then marked in service until IC_EOI.
+uint icack()
+{
+  uint c, m, best, level;
+  if (!ipend) return 0;
+  if (!(icctl & 1)) { for (c = 1; !(ipend & (1 << c)); c++); ipend ^= 1 << c; return c; }
+  for (level = 0, m = icisr; m; m &= m - 1) { for (c = 0; !(m & (1 << c)); c++); if (icpri[c] + 1 > level) level = icpri[c] + 1; }
+  for (best = 0, m = ipend & ~icmask; m; m &= m - 1) { for (c = 0; !(m & (1 << c)); c++); if (icpri[c] + 1 > level) { level = icpri[c] + 1; best = c; } }
+  if (best) { ipend ^= 1 << best; icisr |= 1 << best; }
+  return best;
+}
+
+void iceoi() // end the highest priority interrupt in service
+{
+  uint c, m, best, level;
+  for (best = level = 0, m = icisr; m; m &= m - 1) { for (c = 0; !(m & (1 << c)); c++); if (icpri[c] + 1 > level) { level = icpri[c] + 1; best = c; } }
+  icisr &= ~(1 << best);
+}
+
+uint mseen(char *x, char *y, uint n, uint nul) // bytes a compare looks at, up to the first difference (or NUL when nul)
+{
+  uint k;
+  for (k = 0; k < n && x[k] == y[k] && (!nul || x[k]); k++);
+  return k < n ? k + 1 : n;
+}
+
 void cpu(uint pc, uint sp)
 {
   uint integerRegisterFile[3];
@@ -187,16 +721,21 @@ void cpu(uint pc, uint sp)
 
   uint a, b, c, ssp, usp, t, p, v, u, delta, cycle, xcycle, timer, timeout, fpc, tpc, xsp, tsp, fsp;
   double f, g;
+  long long rtnow;
   int immediate, *xpc, kbchar;
+  uint *cost, slow; // cost model, and any of cost model, cache or branch model, debugger on
+  uint resume; // pc + 1 of a block instruction that yielded, its restart is not fetched or costed again
   char ch;
   struct pollfd pfd;
 
   static char rbuf[4096]; // XXX
 
-  a = b = c = timer = timeout = fpc = tsp = fsp = 0;
+  a = b = c = timer = timeout = fpc = tsp = fsp = resume = 0;
   cycle = delta = 4096;
   xcycle = delta * 4;
   kbchar = -1;
+  cost = costs;
+  slow = cost || pcs || dbg;
   xpc = 0;
   tpc = -pc;
   xsp = sp;
@@ -217,16 +756,18 @@ fixpc:
       fpc = ((uint)xpc + 4096) & -4096;
 next:
       if ((uint)xpc > xcycle) {
+      poll: // a yielding block instruction comes straight here, its xpc-- may have put xpc back under xcycle
         cycle += delta;
         xcycle += delta * 4;
-        if (iena || !(ipend & FKEYBD)) { // XXX dont do this, use a small queue instead
+        if (stall) { xcycle -= stall * 4; stall = 0; } // the next poll comes that much sooner
+        if (iena || !(ipend & (1 << FKEYBD))) { // XXX dont do this, use a small queue instead
           pfd.fd = 0;
           pfd.events = POLLIN;
           if (poll(&pfd, 1, 0) == 1 && read(0, &ch, 1) == 1) {
             kbchar = ch;
             if (kbchar == '`') { dprintf(2,"ungraceful exit. cycle = %u\n", cycle + (int)((uint)xpc - xcycle)/4); return; }
-            if (iena) { trap = FKEYBD; iena = 0; goto interrupt; }
-            ipend |= FKEYBD;
+            ipend |= 1 << FKEYBD;
+            if (iena && (trap = icack())) { iena = 0; goto interrupt; }
           }
         }
         if (timeout) {
@@ -234,58 +775,73 @@ next:
           if (timer >= timeout) { // XXX  // any interrupt actually!
 //          dprintf(2,"timeout! timer=%d, timeout=%d\n",timer,timeout);
             timer = 0;
-            if (iena) { trap = FTIMER; iena = 0; goto interrupt; }
-            ipend |= FTIMER;
+            ipend |= 1 << FTIMER;
+            if (iena && (trap = icack())) { iena = 0; goto interrupt; }
           }
         }
+        if (rtexpired()) {
+          ipend |= 1 << FCLOCK;
+          if (iena && (trap = icack())) { iena = 0; goto interrupt; }
+        }
       }
     }
 
     immediate = *xpc++;
-
-    if (dbg) {
-    again:
-      switch(dbg_getcmd(dbgbuf)) {
-      case 'c':
-        dbg = 0;
-        break;
-      case 's':
-        printf("[%8.8x] %lx\n", (uint)xpc - tpc, *xpc);
-        break;
-      case 'q':
-        exit(0);
-      case 'i':
-        printf(DBG_REG_CONTEX,
-               a, b, c, xsp - tsp, (uint)xpc - tpc, f, g,
-               (user ? usp : ssp) - tsp, user, iena, trap, virtualMemoryEnabled, ipend);
-        goto again;
-      case 'x':
-        if((sscanf(dbgbuf + 1, "%x", &u) != 1)
-           || (!(t = currentReadPageTable[u >> 12]) && !(t = rlook(u))))
-          printf("\ninvalid address: %s.\n", dbgbuf + 1);
-        else
-          printf("\n[%8.8x]: %2.2x\n", u, *((unsigned char *)(u ^ (t & -2))));
-        goto again;
-      case 'h':
-      default:
-        printf(DBG_HELP_STRING);
-        goto again;
+    if (slow) { // cost model, cache or branch model, or debugger
+      if (resume == (uint)xpc - tpc - 3) resume = 0;
+      else {
+        if (cost) xcycle -= cost[(uchar)immediate];
+        if (l1i.tag) cacheinsn((uint)xpc - tpc - 4, immediate, a, b, xsp - tsp);
+      }
+      if (bctr) branchinsn((uint)xpc - tpc - 4, immediate, a, b, f, g);
+      if (dbg) {
+      again:
+        switch(dbg_getcmd(dbgbuf)) {
+        case 'c':
+          dbg = 0;
+          slow = cost || pcs;
+          break;
+        case 's':
+          printf("[%8.8x] %lx\n", (uint)xpc - tpc, *xpc);
+          break;
+        case 'q':
+          exit(0);
+        case 'i':
+          printf(DBG_REG_CONTEX,
+                 a, b, c, xsp - tsp, (uint)xpc - tpc, f, g,
+                 (user ? usp : ssp) - tsp, user, iena, trap, virtualMemoryEnabled, ipend);
+          goto again;
+        case 'x':
+          if((sscanf(dbgbuf + 1, "%x", &u) != 1)
+             || (!(t = currentReadPageTable[u >> 12]) && !(t = rlook(u))))
+            printf("\ninvalid address: %s.\n", dbgbuf + 1);
+          else
+            printf("\n[%8.8x]: %2.2x\n", u, *((unsigned char *)(u ^ (t & -2))));
+          goto again;
+        case 'h':
+        default:
+          printf(DBG_HELP_STRING);
+          goto again;
+        }
       }
     }
 
     switch ((uchar)immediate) {
-    case HALT: if (user || verbose) dprintf(2,"halt(%d) cycle = %u\n", a, cycle + (int)((uint)xpc - xcycle)/4); return; // XXX should be supervisor!
+    case HALT: halt: if (user || verbose) dprintf(2,"halt(%d) cycle = %u\n", a, cycle + (int)((uint)xpc - xcycle)/4);
+      if (l1i.tag) cachereport();
+      if (bctr) branchreport();
+      if (hostsys) exit(a);
+      return; // XXX should be supervisor!
     case IDLE: if (user) { trap = FPRIV; break; }
       if (!iena) { trap = FINST; break; } // XXX this will be fatal !!!
       for (;;) {
         pfd.fd = 0;
         pfd.events = POLLIN;
-        if (poll(&pfd, 1, 0) == 1 && read(0, &ch, 1) == 1) {
+        if (poll(&pfd, 1, (rtdue && !timeout) ? rtwait() : 0) == 1 && read(0, &ch, 1) == 1) { // sleep until the real time timer when no cycle timer runs
           kbchar = ch;
           if (kbchar == '`') { dprintf(2,"ungraceful exit. cycle = %u\n", cycle + (int)((uint)xpc - xcycle)/4); return; }
-          trap = FKEYBD;
-          iena = 0;
-          goto interrupt;
+          ipend |= 1 << FKEYBD;
+          if ((trap = icack())) { iena = 0; goto interrupt; }
         }
         cycle += delta;
         if (timeout) {
@@ -293,14 +849,17 @@ next:
           if (timer >= timeout) { // XXX  // any interrupt actually!
 //        dprintf(2,"IDLE timeout! timer=%d, timeout=%d\n",timer,timeout);
             timer = 0;
-            trap = FTIMER;
-            iena = 0;
-            goto interrupt;
+            ipend |= 1 << FTIMER;
+            if ((trap = icack())) { iena = 0; goto interrupt; }
           }
         }
+        if (rtexpired()) {
+          ipend |= 1 << FCLOCK;
+          if ((trap = icack())) { iena = 0; goto interrupt; }
+        }
       }
 
-    // memory -- designed to be restartable/continuable after exception/interrupt
+    // memory -- designed to be restartable/continuable after exception/interrupt, yields when a long block uses up its cycles
     case MCPY: // while (c) { *a = *b; a++; b++; c--; }
       while (c) {
         if (!(t = currentReadPageTable[b >> 12]) && !(t = rlook(b))) goto exception;
@@ -308,8 +867,10 @@ next:
         if ((v = 4096 - (a & 4095)) > c) v = c;
         if ((u = 4096 - (b & 4095)) > v) u = v;
         memcpy((char *)(a ^ (p & -2)), (char *)(b ^ (t & -2)), u);
+        if (l1d.tag) { cachedata(pcprof((uint)xpc - tpc - 4), b, u); cachedata(pcprof((uint)xpc - tpc - 4), a, u); }
         a += u; b += u; c -= u;
-//        if (!(++cycle % DELTA)) { pc -= 4; break; } XXX
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; } // out of cycles, poll and take interrupts, then restart
       }
       continue;
 
@@ -320,9 +881,15 @@ next:
         if (!(p = currentReadPageTable[a >> 12]) && !(p = rlook(a))) goto exception;
         if ((v = 4096 - (a & 4095)) > c) v = c;
         if ((u = 4096 - (b & 4095)) > v) u = v;
-        if ((t = memcmp((char *)(a ^ (p & -2)), (char *)(b ^ (t & -2)), u))) { a = t; b += c; c = 0; break; }
+        if (l1d.tag) { cachedata(pcprof((uint)xpc - tpc - 4), b, u); cachedata(pcprof((uint)xpc - tpc - 4), a, u); }
+        v = a ^ (p & -2); t = b ^ (t & -2);
+        if ((p = memcmp((char *)v, (char *)t, u))) { // charge the bytes looked at, a partial chunk at least a cycle
+          xcycle -= (mseen((char *)v, (char *)t, u, 0) + (1 << bshift) - 1) >> bshift << 2;
+          a = p; b += c; c = 0; break;
+        }
         a += u; b += u; c -= u;
-//        if (!(++cycle % DELTA)) { pc -= 4; break; } XXX
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
       }
       continue;
 
@@ -331,9 +898,11 @@ next:
         if (!c) { a = 0; break; }
         if (!(p = currentReadPageTable[a >> 12]) && !(p = rlook(a))) goto exception;
         if ((u = 4096 - (a & 4095)) > c) u = c;
-        if ((t = (uint)memchr((char *)(v = a ^ (p & -2)), b, u))) { a += t - v; c = 0; break; }
+        if (l1d.tag) cachedata(pcprof((uint)xpc - tpc - 4), a, u);
+        if ((t = (uint)memchr((char *)(v = a ^ (p & -2)), b, u))) { xcycle -= (t - v + (1 << bshift)) >> bshift << 2; a += t - v; c = 0; break; }
         a += u; c -= u;
-//        if (!(++cycle % DELTA)) { pc -= 4; break; } XXX
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
       }
       continue;
 
@@ -342,8 +911,58 @@ next:
         if (!(p = currentWritePageTable[a >> 12]) && !(p = wlook(a))) goto exception;
         if ((u = 4096 - (a & 4095)) > c) u = c;
         memset((char *)(a ^ (p & -2)), b, u);
+        if (l1d.tag) cachedata(pcprof((uint)xpc - tpc - 4), a, u);
         a += u; c -= u;
-//        if (!(++cycle % DELTA)) { pc -= 4; break; } XXX
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
+      }
+      continue;
+
+    // string -- NUL terminated versions of MCHR and MCMP, also restartable
+    case MSLN: // while (*a) a++;
+      for (;;) {
+        if (!(p = currentReadPageTable[a >> 12]) && !(p = rlook(a))) goto exception;
+        u = 4096 - (a & 4095);
+        if (l1d.tag) cachedata(pcprof((uint)xpc - tpc - 4), a, u);
+        if ((t = (uint)memchr((char *)(v = a ^ (p & -2)), 0, u))) { xcycle -= (t - v + (1 << bshift)) >> bshift << 2; a += t - v; break; }
+        a += u;
+        xcycle -= u >> bshift << 2;
+        if ((uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
+      }
+      continue;
+
+    case MSCM: // for (;;) { if (!c) { a = 0; break; } if (*a != *b || !*a) { a = *a - *b; c = 0; break; } a++; b++; c--; }
+      for (;;) {
+        if (!c) { a = 0; break; }
+        if (!(t = currentReadPageTable[b >> 12]) && !(t = rlook(b))) goto exception;
+        if (!(p = currentReadPageTable[a >> 12]) && !(p = rlook(a))) goto exception;
+        if ((v = 4096 - (a & 4095)) > c) v = c;
+        if ((u = 4096 - (b & 4095)) > v) u = v;
+        if (l1d.tag) { cachedata(pcprof((uint)xpc - tpc - 4), b, u); cachedata(pcprof((uint)xpc - tpc - 4), a, u); }
+        v = a ^ (p & -2); t = b ^ (t & -2);
+        if ((p = strncmp((char *)v, (char *)t, u)) || memchr((char *)v, 0, u)) { // charge the bytes looked at, a partial chunk at least a cycle
+          xcycle -= (mseen((char *)v, (char *)t, u, 1) + (1 << bshift) - 1) >> bshift << 2;
+          a = p; c = 0; break;
+        }
+        a += u; b += u; c -= u;
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
+      }
+      continue;
+
+    // packed vector -- restartable like the block memory ops above, immediate selects 4 x 32-bit (0) or 16 x 8-bit (1) lanes
+    case VADD: case VXOR: case VAND: case VCEQ: case VMN: case VMX: // while (c) { *a = op(*a, *b); a++; b++; c--; } per lane
+      if (!(immediate>>8)) { a &= -4; b &= -4; c &= -4; } // word lanes are aligned like word loads
+      while (c) {
+        if (!(t = currentReadPageTable[b >> 12]) && !(t = rlook(b))) goto exception;
+        if (!(p = currentWritePageTable[a >> 12]) && !(p = wlook(a))) goto exception;
+        if ((v = 4096 - (a & 4095)) > c) v = c;
+        if ((u = 4096 - (b & 4095)) > v) u = v;
+        vec((uchar)immediate, immediate>>8, (char *)(a ^ (p & -2)), (char *)(b ^ (t & -2)), u);
+        if (l1d.tag) { cachedata(pcprof((uint)xpc - tpc - 4), b, u); cachedata(pcprof((uint)xpc - tpc - 4), a, u); }
+        a += u; b += u; c -= u;
+        xcycle -= u >> bshift << 2;
+        if (c && (uint)xpc > xcycle) { xpc--; resume = (uint)xpc - tpc + 1; goto poll; }
       }
       continue;
 
@@ -670,11 +1289,34 @@ next:
     case SSP:  xsp = a; tsp = fsp = 0; goto fixsp;
 
     case NOP:  continue;
-    case CYC:  a = cycle + (int)((uint)xpc - xcycle)/4; continue; // XXX protected?  XXX also need wall clock time instruction
+    case CYC:  a = cycle + stall + (int)((uint)xpc - xcycle)/4; continue; // XXX protected?
+    case CLK:  // host monotonic time since start: us (0), low word of ns (1), high word of that same read (2)
+      if ((u = (uint)immediate >> 8) == 2) { a = clkhi; continue; }
+      rtnow = nsec();
+      if (u) { a = rtnow; clkhi = rtnow >> 32; } else a = rtnow / 1000;
+      continue;
+    case RTMR: if (user) { trap = FPRIV; break; } // real time timer raising FCLOCK after a us, every a us when operand0 is 1, a = 0 stops it
+      rtperiod = (immediate >> 8) ? a * 1000LL : 0;
+      rtdue = a ? nsec() + a * 1000LL : 0;
+      continue;
+    case SNAP: if (user) { trap = FPRIV; break; } // baseline (0), reset to it (1), incremental snapshot to the -s file (2)
+      switch ((uint)immediate >> 8) {
+      case 0: snapbase(); snappc = (uint)xpc - tpc; snapsp = xsp - tsp; a = 0; break;
+      case 1:
+        if (!dirty) { a = -1; continue; }
+        b = snapreset(); flush();
+        xsp = snapsp; tsp = fsp = 0;
+        xcycle += (pc = snappc + tpc) - (uint)xpc;
+        xpc = (int *)pc;
+        goto fixpc; // back after the SNAP 0 with a as given, like longjmp
+      case 2: a = dirty ? snapwrite(0) : -1; break;
+      default: trap = FINST; goto exception;
+      }
+      flush(); fsp = 0; goto fixpc;
     case MSIZ: if (user) { trap = FPRIV; break; } a = memorySize; continue;
 
     case CLI:  if (user) { trap = FPRIV; break; } a = iena; iena = 0; continue;
-    case STI:  if (user) { trap = FPRIV; break; } if (ipend) { trap = ipend & -ipend; ipend ^= trap; iena = 0; goto interrupt; } iena = 1; continue;
+    case STI:  if (user) { trap = FPRIV; break; } if ((trap = icack())) { iena = 0; goto interrupt; } iena = 1; continue;
 
     case RTI:
       if (user) { trap = FPRIV; break; }
@@ -684,11 +1326,71 @@ next:
       if (!(p = currentReadPageTable[xsp >> 12]) && !(p = rlook(xsp))) { dprintf(2,"RTI kstack fault\n"); goto fatal; }
       xcycle += (pc = *(uint *)((xsp ^ p) & -8) + tpc) - (uint)xpc; xsp += 8;
       xpc = (int *)pc;
-      if (t & USER) { ssp = xsp; xsp = usp; user = 1; currentReadPageTable = userReadPageTable; currentWritePageTable = userWritePageTable; }
-      if (!iena) { if (ipend) { trap = ipend & -ipend; ipend ^= trap; goto interrupt; } iena = 1; }
+      if (t & USER) {
+        ssp = xsp; xsp = usp; user = 1; currentReadPageTable = userReadPageTable; currentWritePageTable = userWritePageTable;
+        if (bank) { kbank[0] = a; kbank[1] = b; kbank[2] = c; a = ubank[0]; b = ubank[1]; c = ubank[2]; }
+      }
+      if (!iena) { if ((trap = icack())) goto interrupt; iena = 1; }
       goto fixpc; // page may be invalid
 
     case IVEC: if (user) { trap = FPRIV; break; } ivec = a; continue;
+    case SVEC: if (user) { trap = FPRIV; break; } svec = a; continue;
+
+    case ICR: if (user) { trap = FPRIV; break; } // a = interrupt controller register operand0
+      switch (u = (uint)immediate >> 8) {
+      case IC_CTRL: a = icctl; continue;
+      case IC_MASK: a = icmask; continue;
+      case IC_PEND: a = ipend; continue;
+      case IC_ISR:  a = icisr; continue;
+      }
+      if (u >= IC_VEC && u < IC_PRI) { a = icvec[u - IC_VEC]; continue; }
+      if (u >= IC_PRI && u < IC_END) { a = icpri[u - IC_PRI]; continue; }
+      trap = FINST; break;
+
+    case ICW: if (user) { trap = FPRIV; break; } // interrupt controller register operand0 = a
+      switch (u = (uint)immediate >> 8) {
+      case IC_CTRL: icctl = a; break;
+      case IC_MASK: icmask = a; break;
+      case IC_PEND: ipend = a & -2; break; // software can raise or drop interrupts, cause 0 is not one
+      case IC_ISR:  icisr = a; break;
+      case IC_EOI:  iceoi(); break;
+      default:
+        if (u >= IC_VEC && u < IC_PRI) icvec[u - IC_VEC] = a;
+        else if (u >= IC_PRI && u < IC_END) icpri[u - IC_PRI] = a;
+        else { trap = FINST; goto exception; }
+      }
+      if (iena && (trap = icack())) { iena = 0; goto interrupt; } // a source may have been unblocked
+      continue;
+    case LSYS: if (user) { trap = FPRIV; break; } a = sysno; continue;
+
+    case SYSC: // fast system call, a/b/c pass through untouched and only the return pc is pushed
+      if (hostsys) { host: if ((u = (uint)immediate >> 8) == S_exit) goto halt; a = hostcall(u, a, b, c); continue; }
+      if (!svec) { trap = FSYS; break; } // no fast entry set up, behave as TRAP
+      sysno = immediate >> 8;
+      xsp -= tsp; tsp = fsp = 0;
+      if (user) { usp = xsp; xsp = ssp; user = 0; currentReadPageTable = kernelReadPageTable; currentWritePageTable = kernelWritePageTable; t = 1; } else t = 0;
+      xsp -= 8; if (!(p = currentWritePageTable[xsp >> 12]) && !(p = wlook(xsp))) { dprintf(2,"kstack fault!\n"); goto fatal; }
+      *(uint *)((xsp ^ p) & -8) = ((uint)xpc - tpc) | t; // low bit set when called from user mode
+      if (l1d.tag) cachedata(pcprof((uint)xpc - tpc - 4), xsp, 8);
+      xcycle += svec + tpc - (uint)xpc;
+      xpc = (int *)(svec + tpc);
+      goto fixpc;
+
+    case SYSR: // return from SYSC
+      if (user) { trap = FPRIV; break; }
+      xsp -= tsp; tsp = fsp = 0;
+      if (!(p = currentReadPageTable[xsp >> 12]) && !(p = rlook(xsp))) { dprintf(2,"SYSR kstack fault\n"); goto fatal; }
+      if (l1d.tag) cachedata(pcprof((uint)xpc - tpc - 4), xsp, 8);
+      t = *(uint *)((xsp ^ p) & -8); xsp += 8;
+      xcycle += (pc = (t & -4) + tpc) - (uint)xpc;
+      xpc = (int *)pc;
+      if (t & 1) { ssp = xsp; xsp = usp; user = 1; currentReadPageTable = userReadPageTable; currentWritePageTable = userWritePageTable; }
+      goto fixpc;
+
+    case BANK: if (user) { trap = FPRIV; break; } bank = a; continue; // enable banked registers with a as the user entry vector
+    case LUBK: if (user) { trap = FPRIV; break; } if ((u = (uint)immediate >> 8) > 2) { trap = FINST; break; } a = ubank[u]; continue;
+    case SUBK: if (user) { trap = FPRIV; break; } if ((u = (uint)immediate >> 8) > 2) { trap = FINST; break; } ubank[u] = a; continue;
+
     case PDIR: if (user) { trap = FPRIV; break; } if (a > memorySize) { trap = FMEM; break; } pageDirectory = (memory + a) & -4096; flush(); fsp = 0; goto fixpc; // set page directory
     case SPAG: if (user) { trap = FPRIV; break; } if (a && !pageDirectory) { trap = FMEM; break; } virtualMemoryEnabled = a; flush(); fsp = 0; goto fixpc; // enable paging
 
@@ -700,7 +1402,7 @@ next:
 
     case LVAD: if (user) { trap = FPRIV; break; } a = vadr; continue;
 
-    case TRAP: trap = FSYS; break;
+    case TRAP: if (hostsys) goto host; trap = FSYS; break;
 
     case LUSP: if (user) { trap = FPRIV; break; } a = usp; continue;
     case SUSP: if (user) { trap = FPRIV; break; } usp = a; continue;
@@ -711,22 +1413,65 @@ exception:
     if (!iena) { dprintf(2,"exception in interrupt handler\n"); goto fatal; }
 interrupt:
     xsp -= tsp; tsp = fsp = 0;
-    if (user) { usp = xsp; xsp = ssp; user = 0; currentReadPageTable = kernelReadPageTable; currentWritePageTable = kernelWritePageTable; trap |= USER; }
+    if (user) {
+      usp = xsp; xsp = ssp; user = 0; currentReadPageTable = kernelReadPageTable; currentWritePageTable = kernelWritePageTable; trap |= USER;
+      if (bank) { ubank[0] = a; ubank[1] = b; ubank[2] = c; a = kbank[0]; b = kbank[1]; c = kbank[2]; }
+    }
     xsp -= 8; if (!(p = currentWritePageTable[xsp >> 12]) && !(p = wlook(xsp))) { dprintf(2,"kstack fault!\n"); goto fatal; }
     *(uint *)((xsp ^ p) & -8) = (uint)xpc - tpc;
     xsp -= 8; if (!(p = currentWritePageTable[xsp >> 12]) && !(p = wlook(xsp))) { dprintf(2,"kstack fault\n"); goto fatal; }
     *(uint *)((xsp ^ p) & -8) = trap;
-    xcycle += ivec + tpc - (uint)xpc;
-    xpc = (int *)(ivec + tpc);
+    if (!(icctl & 1) || !(u = icvec[trap & 15])) u = (bank && (trap & USER)) ? bank : ivec;
+    if (l1d.tag) cachedata(pcprof(u), xsp, 16); // the frame pushed for the handler
+    xcycle += u + tpc - (uint)xpc;
+    xpc = (int *)(u + tpc);
     goto fixpc;
   }
 fatal:
   dprintf(2,"processor halted! cycle = %u pc = %08x ir = %08x sp = %08x a = %d b = %d c = %d trap = %u\n", cycle + (int)((uint)xpc - xcycle)/4, (uint)xpc - tpc, immediate, xsp - tsp, a, b, c, trap);
 }
 
+// cost model, lines of "name cycles" with # comments:  an opcode mnemonic sets what the instruction
+// costs (1 by default), "bytes" how many bytes of a block instruction make a cycle (rounded down to a
+// power of 2, 8 by default), "tlb" the cost of filling a page translation and "walk" of reading a
+// page directory entry on a miss in the page walk cache
+void loadcosts(char *file)
+{
+  int f, i, n; char *s, *e, *w; struct stat st;
+
+  if ((f = open(file, O_RDONLY)) < 0) { dprintf(2,"%s : couldn't open cost file %s\n", cmd, file); exit(-1); }
+  if (fstat(f, &st)) { dprintf(2,"%s : couldn't stat cost file %s\n", cmd, file); exit(-1); }
+  s = new(st.st_size + 1);
+  if (read(f, s, st.st_size) != st.st_size) { dprintf(2,"%s : failed to read cost file %s\n", cmd, file); exit(-1); }
+  close(f);
+  e = s + st.st_size; *e = 0;
+  costs = (uint *) new(256 * sizeof(uint));
+  memset(costs, 0, 256 * sizeof(uint));
+
+  for (;;) {
+    while (s < e && (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')) s++;
+    if (s >= e) return;
+    if (*s == '#') { while (s < e && *s != '\n') s++; continue; }
+    w = s;
+    while (s < e && *s > ' ') s++;
+    n = s - w;
+    while (s < e && (*s == ' ' || *s == '\t')) s++;
+    if (*s < '0' || *s > '9') { dprintf(2,"%s : %s: no cycle count for %.*s\n", cmd, file, n, w); exit(-1); }
+    i = atoi(s);
+    while (s < e && *s >= '0' && *s <= '9') s++;
+    if (n == 5 && !memcmp(w, "bytes", 5)) { if (i < 1) i = 1; for (bshift = 0; (2 << bshift) <= i; bshift++); continue; }
+    if (n == 3 && !memcmp(w, "tlb", 3)) { tlbcost = i; continue; }
+    if (n == 4 && !memcmp(w, "walk", 4)) { walkcost = i; continue; }
+    for (f = 0; ops[f * 5]; f++)
+      if (n <= 4 && !memcmp(&ops[f * 5], w, n) && (n == 4 || ops[f * 5 + n] == ' ')) break;
+    if (!ops[f * 5]) { dprintf(2,"%s : %s: unknown instruction %.*s\n", cmd, file, n, w); exit(-1); }
+    costs[f] = (i - 1) * 4;
+  }
+}
+
 void usage()
 {
-  dprintf(2,"%s : usage: %s [-g] [-v] [-m memsize] [-f filesys] file\n", cmd, cmd);
+  dprintf(2,"%s : usage: %s [-g] [-v] [-m memsize] [-f filesys] [-c costs] [-C caches] [-B branches] [-y symbols] [-s snapshots] [-u] file [args]\n", cmd, cmd);
   exit(-1);
 }
 
@@ -741,15 +1486,23 @@ int main(int argc, char *argv[])
   if (argc < 2) usage();
   file = *argv;
   memorySize = MEM_SZ;
+  rtbase = nsec();
   fs = 0;
   dbg = 0;
   verbose = 0;
+  snapfd = -1;
   while (--argc && *file == '-') {
     switch(file[1]) {
     case 'g': dbg = 1; break;
     case 'v': verbose = 1; break;
     case 'm': memorySize = atoi(*++argv) * (1024 * 1024); argc--; break;
     case 'f': fs = *++argv; argc--; break;
+    case 'c': loadcosts(*++argv); argc--; break;
+    case 'C': cacheinit(*++argv); argc--; break;
+    case 'B': branchinit(*++argv); argc--; break;
+    case 'y': loadsyms(*++argv); argc--; break;
+    case 'u': hostsys = 1; break;
+    case 's': if ((snapfd = open(*++argv, O_WRONLY | O_CREAT | O_TRUNC)) < 0) { dprintf(2,"%s : couldn't open snapshot file %s\n", cmd, *argv); return -1; } argc--; break;
     default: usage();
     }
     file = *++argv;
@@ -757,7 +1510,7 @@ int main(int argc, char *argv[])
 
   if (dbg) dprintf(2,"in debuger mode\n");
   if (verbose) dprintf(2,"mem size = %u\n",memorySize);
-  memory = (((int) new(memorySize + 4096)) + 4095) & -4096;
+  memory = (int) zalloc(memorySize); // page aligned
 
   if (fs) {
     if (verbose) dprintf(2,"%s : loading ram file system %s\n", cmd, fs);
@@ -778,15 +1531,16 @@ int main(int argc, char *argv[])
 
 //  if (verbose) dprintf(2,"entry = %u text = %u data = %u bss = %u\n", hdr.entry, hdr.text, hdr.data, hdr.bss);
 
-  // setup virtual memory
-  kernelReadPageTable = (uint *) new(TB_SZ * sizeof(uint)); // kernel read table
-  kernelWritePageTable = (uint *) new(TB_SZ * sizeof(uint)); // kernel write table
-  userReadPageTable = (uint *) new(TB_SZ * sizeof(uint)); // user read table
-  userWritePageTable = (uint *) new(TB_SZ * sizeof(uint)); // user write table
+  // setup virtual memory, the tables only take host pages where translations get cached
+  kernelReadPageTable = (uint *) zalloc(TB_SZ * sizeof(uint)); // kernel read table
+  kernelWritePageTable = (uint *) zalloc(TB_SZ * sizeof(uint)); // kernel write table
+  userReadPageTable = (uint *) zalloc(TB_SZ * sizeof(uint)); // user read table
+  userWritePageTable = (uint *) zalloc(TB_SZ * sizeof(uint)); // user write table
   currentReadPageTable = kernelReadPageTable;
   currentWritePageTable = kernelWritePageTable;
 
   if (verbose) dprintf(2,"%s : emulating %s\n", cmd, file);
-  cpu(hdr.entry, memorySize - FS_SZ);
+  if (hostsys) cpu(hdr.entry, hostargs(argc, argv, st.st_size - sizeof(hdr) + hdr.bss));
+  else cpu(hdr.entry, memorySize - FS_SZ);
   return 0;
 }
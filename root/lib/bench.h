@@ -0,0 +1,53 @@
+// bench.h -- scaffolding shared by the benchmarks that run on the bare emulator
+//
+// Results go straight to the console, one line per measurement: "name: figures" ending in ok or
+// FAILED.  Cycles are emulated cycles as read by CYC.  bns() reads the host monotonic clock, so a
+// figure in ns or us is host time spent emulating.
+//
+// A benchmark that uses libc calls bkernel() first.  Its trap handler stands in for the kernel:
+// S_sbrk hands out a fixed heap region above the program, S_write goes to the console and S_exit
+// halts.  A program that needs more sets bsys, which sees every call first and returns nonzero
+// when it has served it.
+
+enum { B_FSYS = 5, B_HEAP = 16*1024*1024, B_HEAP_SZ = 64*1024*1024 }; // the heap lies between program and stack
+
+int bbrk,      // heap handed out
+    bsbrks;    // sbrk calls
+int (*bsys)(); // bsys(n, &a, b, c) serves system call n and returns nonzero, or leaves it to btrap
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+int cyc()       { asm(CYC); }
+uint bns()      { asm(CLK,1); }
+
+bputs(char *s) { while (*s) out(1, *s++); }
+bputn(uint n)  { if (n >= 10) bputn(n / 10); out(1, '0' + n % 10); }
+bok(int ok)    { bputs(ok ? " ok\n" : " FAILED\n"); }
+
+void *bsbrk(int n) { int p; bsbrks++; if (bbrk + n > B_HEAP_SZ) return (void *)-1; p = B_HEAP + bbrk; bbrk += n; return (void *)p; }
+
+btrap(int c, int b, int a, int fc, uint *pc)
+{
+  int i;
+  if (fc != B_FSYS || (bsys && bsys(pc[-1] >> 8, &a, b, c))) return;
+  switch (pc[-1] >> 8) {
+  case S_sbrk:  a = (int)bsbrk(a); break;
+  case S_write: for (i = 0; i < c; i++) out(1, ((char *)b)[i]); a = c; break;
+  case S_exit:  asm(HALT);
+  default:      a = -1; break;
+  }
+}
+
+balltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  btrap();
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+bkernel() { ivec(balltraps); asm(STI); }
@@ -5,51 +5,90 @@ enum { S_IFIFO = 0x1000, S_IFCHR = 0x2000, S_IFBLK = 0x3000, S_IFDIR = 0x4000, S
 enum { O_RDONLY, O_WRONLY, O_RDWR, O_CREAT = 0x100, O_TRUNC = 0x200 };
 enum { SEEK_SET, SEEK_CUR, SEEK_END };
 enum { BUFSIZ = 1024, NAME_MAX = 256, PATH_MAX = 256 }; // XXX
+enum { _IOFBF, _IOLBF, _IONBF, FOPEN_MAX = 16 };
 enum { POLLIN = 1, POLLOUT = 2, POLLNVAL = 4 };
+enum { PROT_READ = 1, PROT_WRITE = 2, MAP_PRIVATE = 2, MAP_ANONYMOUS = 0x20 };
 
 struct stat { ushort st_dev; ushort st_mode; uint st_ino; uint st_nlink; uint st_size; };
 struct pollfd { int fd; short events, revents; };
 
+// stdio stream.  Either the read window rpos..rend holds data read ahead, or buf..wpos holds output
+// not yet written and wend marks the end of room in the buffer, never both.
+typedef struct { int fd, flags, mode; uint size; char *buf, *rpos, *rend, *wpos, *wend, ch; } FILE;
+
 // intrinsics
 void *memcpy() { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCPY); asm(LL,8); }
 void *memset() { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); asm(LL,8); }
 int   memcmp() { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCMP); }
 void *memchr() { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MCHR); }
+int   strlen() { asm(LL,8); asm(MSLN); asm(LBL,8); asm(SUB); }
+int   strcmp() { asm(LI,-1); asm(LCA); asm(LL,8); asm(LBL,16); asm(MSCM); }
+int  strncmp(char *d, char *s, int n) { if (n <= 0) return 0; asm(LL,8); asm(LBL,16); asm(LCL,24); asm(MSCM); } // MSCM would take n < 0 as a huge count
+
+// system calls -- SYSC enters through the kernel fast entry when SVEC has set one, else traps
+fork()   { asm(SYSC,S_fork); }
+_exit()  { asm(LL,8); asm(SYSC,S_exit); }
+wait()   { asm(SYSC,S_wait); }
+pipe()   { asm(LL,8); asm(SYSC,S_pipe); }
+write()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_write); }
+read()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_read); }
+close()  { asm(LL,8); asm(SYSC,S_close); }
+kill()   { asm(LL,8); asm(SYSC,S_kill); }
+exec()   { asm(LL,8); asm(LBL,16); asm(SYSC,S_exec); } 
+open()   { asm(LL,8); asm(LBL,16); asm(SYSC,S_open); } // XXX 3rd arg?
+mknod()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_mknod); }
+unlink() { asm(LL,8); asm(SYSC,S_unlink); }
+fstat()  { asm(LL,8); asm(LBL,16); asm(SYSC,S_fstat); }
+link()   { asm(LL,8); asm(LBL,16); asm(SYSC,S_link); }
+mkdir()  { asm(LL,8); asm(SYSC,S_mkdir); }
+chdir()  { asm(LL,8); asm(SYSC,S_chdir); }
+dup2()   { asm(LL,8); asm(LBL,16); asm(SYSC,S_dup2); }
+getpid() { asm(SYSC,S_getpid); }
+void *sbrk() { asm(LL,8); asm(SYSC,S_sbrk); }
+sleep()  { asm(LL,8); asm(SYSC,S_sleep); } // XXX is this seconds? should it be?
+uptime() { asm(SYSC,S_uptime); }
+lseek()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_lseek); }
+mount()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_mount); }
+umount() { asm(LL,8); asm(SYSC,S_umount); }
+poll()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(SYSC,S_poll); }
+ringsetup() { asm(LL,8); asm(SYSC,S_ringsetup); }
+ringenter() { asm(SYSC,S_ringenter); }
+
+// system call ring -- queue calls in user space and run a whole batch with one ringenter() trap.
+// ringq() submits by itself when the queue is full.  Results are picked up with ringreap().
+struct ring *uring;
+
+int ringinit(struct ring *r) { memset(r, 0, sizeof(struct ring)); uring = r; return ringsetup(r); }
+
+int ringq(int op, int a, int b, int c, int tag)
+{
+  struct ring *r = uring; struct sqe *e;
+  if (r->sq_tail - r->sq_head == RING_SZ) {
+    ringenter();
+    if (r->sq_tail - r->sq_head == RING_SZ) return -1; // completions not reaped
+  }
+  e = &r->sq[r->sq_tail++ & (RING_SZ - 1)];
+  e->op = op; e->a = a; e->b = b; e->c = c; e->tag = tag;
+  return 0;
+}
 
-// system calls
-fork()   { asm(TRAP,S_fork); }
-exit()   { asm(LL,8); asm(TRAP,S_exit); }
-wait()   { asm(TRAP,S_wait); }
-pipe()   { asm(LL,8); asm(TRAP,S_pipe); }
-write()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_write); }
-read()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_read); }
-close()  { asm(LL,8); asm(TRAP,S_close); }
-kill()   { asm(LL,8); asm(TRAP,S_kill); }
-exec()   { asm(LL,8); asm(LBL,16); asm(TRAP,S_exec); } 
-open()   { asm(LL,8); asm(LBL,16); asm(TRAP,S_open); } // XXX 3rd arg?
-mknod()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_mknod); }
-unlink() { asm(LL,8); asm(TRAP,S_unlink); }
-fstat()  { asm(LL,8); asm(LBL,16); asm(TRAP,S_fstat); }
-link()   { asm(LL,8); asm(LBL,16); asm(TRAP,S_link); }
-mkdir()  { asm(LL,8); asm(TRAP,S_mkdir); }
-chdir()  { asm(LL,8); asm(TRAP,S_chdir); }
-dup2()   { asm(LL,8); asm(LBL,16); asm(TRAP,S_dup2); }
-getpid() { asm(TRAP,S_getpid); }
-void *sbrk() { asm(LL,8); asm(TRAP,S_sbrk); }
-sleep()  { asm(LL,8); asm(TRAP,S_sleep); } // XXX is this seconds? should it be?
-uptime() { asm(TRAP,S_uptime); }
-lseek()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_lseek); }
-mount()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_mount); }
-umount() { asm(LL,8); asm(TRAP,S_umount); }
-poll()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_poll); }
+int ringread(int fd, void *p, int n, int tag)  { return ringq(S_read, fd, (int)p, n, tag); }
+int ringwrite(int fd, void *p, int n, int tag) { return ringq(S_write, fd, (int)p, n, tag); }
+int ringopen(char *name, int mode, int tag)    { return ringq(S_open, (int)name, mode, 0, tag); }
+
+int ringreap(int *res, int *tag) // next completion, 0 if there is none
+{
+  struct cqe *c;
+  if (uring->cq_head == uring->cq_tail) return 0;
+  c = &uring->cq[uring->cq_head++ & (RING_SZ - 1)];
+  *res = c->res; *tag = c->tag;
+  return 1;
+}
 
 // string routines
-int strcmp(char *d, char *s) { for (; *d == *s; d++, s++) if (!*d) return 0; return *d - *s; }
-int strlen(char *s) { return memchr(s, 0, -1) - s; }
 char *strcpy(char *d, char *s) { return memcpy(d, s, strlen(s)+1); }
-char *strcat(char *d, char *s) { memcpy(memchr(d, 0, -1), s, strlen(s)+1); return d; }
-int strncmp(char *d, char *s, int n) { while (n > 0) { if (!*d || *d != *s) return *d - *s; n--; d++; s++; } return 0; }
-char *strchr(char *s, int c) { return memchr(s, c, strlen(s)); }
+char *strcat(char *d, char *s) { memcpy(d + strlen(d), s, strlen(s)+1); return d; }
+char *strchr(char *s, int c) { return memchr(s, c, strlen(s)+1); }
 // XXX strncpy
 // XXX index
 // XXX rindex
@@ -108,13 +147,81 @@ int vsprintf(char *s, char *f, va_list v)
 }
 
 int sprintf(char *s, char *f, ...) { va_list v; va_start(v, f); return vsprintf(s, f, v); }
-int printf(char *f, ...) { char s[BUFSIZ]; va_list v; va_start(v, f); return write(1, s, vsprintf(s, f, v)); }
-int vprintf(char *f, va_list v) { char s[BUFSIZ]; return write(1, s, vsprintf(s, f, v)); }
 int dprintf(int d, char *f, ...) { char s[BUFSIZ]; va_list v; va_start(v, f); return write(d, s, vsprintf(s, f, v)); }
 int vdprintf(int d, char *f, va_list v) { char s[BUFSIZ]; return write(d, s, vsprintf(s, f, v)); }
 
-void *malloc(uint n) { int i = sbrk(n); return (i == -1) ? 0 : i; } // XXX placeholder, see mem.h
-void free(void *p) { } // XXX
+// mapped files -- the kernels have no file backed pages, so a private mapping is read into fresh
+// memory, with the rest of its last page zero as it would be under mmap
+void *mmap(void *a, uint n, int prot, int flags, int fd, int off)
+{
+  char *p; int r, c, m;
+  m = (n + 4095) & -4096;
+  if ((int)(p = sbrk(m)) == -1) return p;
+  r = 0;
+  if (!(flags & MAP_ANONYMOUS)) {
+    if (lseek(fd, off, SEEK_SET) < 0) { sbrk(-m); return (void *)-1; }
+    while (r < n && (c = read(fd, p + r, n - r))) { // a short read is not the end of the file
+      if (c < 0) { sbrk(-m); return (void *)-1; }
+      r += c;
+    }
+  }
+  memset(p + r, 0, m - r);
+  return p;
+}
+
+// memory allocator -- small blocks come from per size class free lists carved out of sbrk'd slabs,
+// large blocks are rounded up to 8K, 12K, 16K, 24K ... and kept on their own per class lists.
+// Only slab refills and large blocks that have never been freed before trap.
+enum { M_HDR = 8, M_SMALL = 4096, M_SLAB = 64*1024, M_NCLASS = 17, M_NLARGE = 40 };
+
+int mclass[M_NCLASS] = { 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096 }; // block sizes including header
+uchar mindex[M_SMALL/8 + 1]; // size class for each 8 byte multiple
+char *mfree[M_NCLASS],       // small block free lists
+     *mlarge[M_NLARGE],      // large block free lists
+     *mtop, *mend;           // unused part of current slab
+
+void *mcore(uint n) // n (a multiple of 8) more bytes of heap, 8 byte aligned
+{
+  int p, g;
+  if ((p = (int)sbrk(n)) == -1) return 0;
+  if ((g = -p & 7) && (int)sbrk(g) == -1) return 0; // only a break someone else left unaligned pays for the padding
+  return (void *)(p + g);
+}
+
+void *malloc(uint n)
+{
+  char *p; uint s; int c;
+
+  if (n <= M_SMALL - M_HDR) {
+    if (!mindex[M_SMALL/8]) for (s = c = 0; s <= M_SMALL/8; s++) { if (s*8 > mclass[c]) c++; mindex[s] = c; }
+    c = mindex[(n + M_HDR + 7) >> 3];
+    if ((p = mfree[c])) { mfree[c] = *(char **)p; return p; }
+    s = mclass[c];
+    if (mtop + s > mend) {
+      if (!(p = mcore(M_SLAB))) return 0;
+      if (p != mend) mtop = p; // not contiguous, the old slab's tail is given up
+      mend = p + M_SLAB;
+    }
+    p = mtop; mtop += s;
+  } else {
+    if ((int)n < 0) return 0; // class sizes would overflow
+    for (s = 2*M_SMALL, c = 0; s < n + M_HDR; c++) s += (s & (s - 1)) ? s / 3 : s / 2;
+    if ((p = mlarge[c])) { mlarge[c] = *(char **)(p + M_HDR); return p + M_HDR; }
+    if (!(p = mcore(s))) return 0;
+  }
+  ((uint *)p)[0] = s;
+  ((uint *)p)[1] = c;
+  return p + M_HDR;
+}
+
+void free(void *v)
+{
+  uint *p;
+  if (!v) return;
+  p = (uint *)v - 2;
+  if (p[0] <= M_SMALL) { *(char **)v = mfree[p[1]]; mfree[p[1]] = v; }
+  else { *(char **)v = mlarge[p[1]]; mlarge[p[1]] = (char *)p; }
+}
 
 int atoi(char *s)
 {
@@ -126,3 +233,183 @@ int atoi(char *s)
 }
 
 int stat(char *n, struct stat *s) { int f, r; if ((f = open(n, O_RDONLY)) < 0) return -1; r = fstat(f, s); close(f); return r; }
+
+// buffered stdio -- streams collect output and read input ahead in a user space buffer, so a
+// system call is made once per buffer (or per line for line buffered output) rather than per call.
+// The standard streams start out zeroed and are set up on first use: stdout is line buffered
+// unless it is a regular file, stderr is unbuffered.
+enum { F_READ = 1, F_WRITE = 2, F_EOF = 4, F_ERR = 8, F_MYBUF = 16 };
+
+FILE stdin[1], stdout[1], stderr[1], fstreams[FOPEN_MAX];
+
+void fstd(FILE *f)
+{
+  struct stat st;
+  if (f->flags) return;
+  if (f == stdin) { f->fd = 0; f->flags = F_READ; f->mode = _IOFBF; }
+  else if (f == stdout) { f->fd = 1; f->flags = F_WRITE; f->mode = (!fstat(1, &st) && (st.st_mode & S_IFMT) == S_IFREG) ? _IOFBF : _IOLBF; }
+  else if (f == stderr) { f->fd = 2; f->flags = F_WRITE; f->mode = _IONBF; }
+}
+
+void fbuf(FILE *f)
+{
+  fstd(f);
+  if (!f->size) f->size = BUFSIZ;
+  if (f->mode == _IONBF || !(f->buf = malloc(f->size))) { f->mode = _IONBF; f->buf = &f->ch; f->size = 1; }
+  else f->flags |= F_MYBUF;
+  f->rpos = f->rend = f->wpos = f->wend = f->buf;
+}
+
+int fflush(FILE *f)
+{
+  int i, n; char *p;
+  if (!f) { // all streams
+    for (i = n = 0; i < FOPEN_MAX; i++) n |= fflush(&fstreams[i]);
+    return n | fflush(stdout) | fflush(stderr);
+  }
+  for (p = f->buf; p < f->wpos; p += n) {
+    if ((n = write(f->fd, p, f->wpos - p)) <= 0) { f->flags |= F_ERR; f->wpos = f->buf; return EOF; }
+  }
+  f->wpos = f->buf;
+  return 0;
+}
+
+uint fwrite(void *p, uint size, uint n, FILE *f)
+{
+  uint t, k; int i; char *s = p;
+
+  if (!(t = size * n)) return 0;
+  if (!f->buf) fbuf(f);
+  if (!(f->flags & F_WRITE)) { f->flags |= F_ERR; return 0; }
+  if (f->wend == f->buf) { // switch to writing, dropping any read ahead
+    if (f->rpos < f->rend) lseek(f->fd, f->rpos - f->rend, SEEK_CUR);
+    f->rpos = f->rend = f->wpos = f->buf;
+    f->wend = f->buf + (f->mode == _IONBF ? 0 : f->size);
+  }
+  if (t > f->wend - f->wpos) {
+    if (fflush(f)) return 0;
+    if (t >= f->wend - f->wpos) { // too big to be worth buffering
+      for (k = 0; k < t; k += i) if ((i = write(f->fd, s + k, t - k)) <= 0) { f->flags |= F_ERR; return k / size; }
+      return n;
+    }
+  }
+  memcpy(f->wpos, s, t);
+  f->wpos += t;
+  if (f->mode == _IOLBF && memchr(s, '\n', t) && fflush(f)) return 0;
+  return n;
+}
+
+int fputc(int c, FILE *f)
+{
+  char b;
+  if (f->wpos < f->wend && (c != '\n' || f->mode != _IOLBF)) return (uchar)(*f->wpos++ = c);
+  b = c;
+  return fwrite(&b, 1, 1, f) ? (uchar)c : EOF;
+}
+
+int putc(int c, FILE *f) { return fputc(c, f); }
+int putchar(int c) { return fputc(c, stdout); }
+int fputs(char *s, FILE *f) { uint n = strlen(s); return fwrite(s, 1, n, f) == n ? 0 : EOF; }
+int puts(char *s) { return (fputs(s, stdout) || fputc('\n', stdout) == EOF) ? EOF : 0; }
+
+int frefill(FILE *f) // read window empty, fill it and return the first char
+{
+  int n;
+  if (!f->buf) fbuf(f);
+  if (!(f->flags & F_READ)) { f->flags |= F_ERR; return EOF; }
+  if (f->wpos > f->buf && fflush(f)) return EOF;
+  f->wpos = f->wend = f->buf;
+  if (f == stdin && stdout[0].mode == _IOLBF) fflush(stdout); // show any prompt before waiting for input
+  if ((n = read(f->fd, f->buf, f->size)) <= 0) { f->flags |= n ? F_ERR : F_EOF; f->rpos = f->rend = f->buf; return EOF; }
+  f->rpos = f->buf + 1;
+  f->rend = f->buf + n;
+  return *(uchar *)f->buf;
+}
+
+int fgetc(FILE *f) { if (f->rpos < f->rend) return *(uchar *)f->rpos++; return frefill(f); }
+int getc(FILE *f) { return fgetc(f); }
+int getchar() { return fgetc(stdin); }
+
+char *fgets(char *s, int n, FILE *f)
+{
+  char *d = s, *p; int k;
+  while (n > 1) {
+    if (f->rpos >= f->rend) { if (frefill(f) == EOF) break; f->rpos--; }
+    if ((k = f->rend - f->rpos) > n - 1) k = n - 1;
+    if ((p = memchr(f->rpos, '\n', k))) k = p - f->rpos + 1;
+    memcpy(d, f->rpos, k);
+    d += k; f->rpos += k; n -= k;
+    if (p) break;
+  }
+  if (d == s) return 0;
+  *d = 0;
+  return s;
+}
+
+uint fread(void *p, uint size, uint n, FILE *f)
+{
+  uint t, k; int i; char *d = p;
+  if (!(t = size * n)) return 0;
+  for (k = 0; k < t; k += i) {
+    if (f->rpos >= f->rend) { if (frefill(f) == EOF) break; f->rpos--; }
+    if ((i = f->rend - f->rpos) > t - k) i = t - k;
+    memcpy(d + k, f->rpos, i);
+    f->rpos += i;
+  }
+  return k / size;
+}
+
+FILE *fopen(char *name, char *mode)
+{
+  FILE *f; int i, m;
+  for (i = 0; fstreams[i].flags; ) if (++i == FOPEN_MAX) return 0;
+  f = &fstreams[i];
+  switch (*mode) {
+  case 'r': m = O_RDONLY; f->flags = F_READ; break;
+  case 'w': m = O_WRONLY | O_CREAT | O_TRUNC; f->flags = F_WRITE; break;
+  case 'a': m = O_WRONLY | O_CREAT; f->flags = F_WRITE; break;
+  default: return 0;
+  }
+  if (strchr(mode, '+')) { m = (m & ~3) | O_RDWR; f->flags = F_READ | F_WRITE; }
+  if ((f->fd = open(name, m)) < 0) { f->flags = 0; return 0; }
+  if (*mode == 'a') lseek(f->fd, 0, SEEK_END);
+  f->mode = _IOFBF;
+  return f;
+}
+
+int fclose(FILE *f)
+{
+  int r = fflush(f);
+  if (close(f->fd) < 0) r = EOF;
+  if (f->flags & F_MYBUF) free(f->buf);
+  memset(f, 0, sizeof(FILE));
+  return r;
+}
+
+int setvbuf(FILE *f, char *buf, int mode, uint size) // call before any I/O on the stream, a null buf gets size bytes malloc'd on first use
+{
+  fstd(f);
+  if (fflush(f)) return EOF;
+  if (f->flags & F_MYBUF) { free(f->buf); f->flags &= ~F_MYBUF; }
+  f->mode = mode;
+  if (mode == _IONBF || !size) { buf = 0; size = 0; }
+  f->size = size;
+  f->buf = f->rpos = f->rend = f->wpos = f->wend = buf;
+  return 0;
+}
+
+int feof(FILE *f) { return f->flags & F_EOF; }
+int ferror(FILE *f) { return f->flags & F_ERR; }
+void clearerr(FILE *f) { f->flags &= ~(F_EOF | F_ERR); }
+int fileno(FILE *f) { fstd(f); return f->fd; }
+
+int vfprintf(FILE *fp, char *f, va_list v) { char s[BUFSIZ]; return fwrite(s, 1, vsprintf(s, f, v), fp); }
+int fprintf(FILE *fp, char *f, ...) { va_list v; va_start(v, f); return vfprintf(fp, f, v); }
+int vprintf(char *f, va_list v) { return vfprintf(stdout, f, v); }
+int printf(char *f, ...) { va_list v; va_start(v, f); return vfprintf(stdout, f, v); }
+
+exit(int r) { fflush(0); _exit(r); }
+
+// program entry -- c starts a program here when it is defined, so a main that returns still has
+// its buffered output flushed; main is called undeclared and may be declared int or void
+_start(int argc, char **argv) { int r; r = main(argc, argv); fflush(0); return r; }
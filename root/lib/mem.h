@@ -1,69 +1,163 @@
-// mem.h -- modifed K&R memory allocator  XXX do not use... currently under development
+// mem.h -- two level segregated fit memory allocator with boundary tags, O(1) malloc and free
+//
+// Standalone: needs only sbrk() and memcpy(), so kernels and programs that bring their own heap
+// can use it in place of the libc.h allocator.
+//
+// A block is an 8 byte header { psize, size } followed by the user data.  size is the distance to
+// the next block with the low bits used as flags.  When M_PFREE is set, psize holds the size of the
+// free block just below (its boundary tag), so free() can coalesce with both neighbours without a
+// search.  Free blocks are listed by log2 of their size (first level) and the next four bits
+// (second level).  A bitmap per level finds the smallest non-empty list that fits in a couple of
+// find-first-set steps.  Each sbrk'd arena ends in a zero sized in-use sentinel block.
 
-struct alloc_s { struct alloc_s *ptr; uint size; } *allocp;
+enum { M_HDR = 8, M_MIN = 16, M_SL = 16, M_SLLOG = 4, M_ARENA = 64*1024 };
+enum { M_MAX = 0x70000000 }; // largest request, keeps the rounded size below first level 31
+enum { M_FREE = 1, M_PFREE = 2, M_FLAGS = 7 };
+
+struct mblk_s { uint psize, size; struct mblk_s *next, *prev; }; // next and prev overlay user data while free
+
+struct mblk_s *mlist[32 * M_SL], // free lists
+              *mtail;            // sentinel of the newest arena
+uint mflmap, mslmap[32];         // non-empty first level lists, non-empty second level lists
+int mdebruijn[32] = { 0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8, 31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9 };
+
+int mffs(uint x) { x &= -x; x *= 0x077CB531; return mdebruijn[x >> 27]; } // lowest set bit, x must be non-zero
+int mfls(uint x) { x |= x >> 1; x |= x >> 2; x |= x >> 4; x |= x >> 8; x |= x >> 16; return mffs(x ^ (x >> 1)); } // highest set bit
+
+int mlevel(uint s) { int fl = mfls(s); return fl * M_SL + ((s >> (fl - M_SLLOG)) & (M_SL - 1)); } // list index for a size >= M_MIN
+
+void minsert(struct mblk_s *b)
+{
+  int i = mlevel(b->size & -8);
+  b->prev = 0;
+  if ((b->next = mlist[i])) b->next->prev = b;
+  mlist[i] = b;
+  mflmap |= 1 << (i / M_SL);
+  mslmap[i / M_SL] |= 1 << (i & (M_SL - 1));
+}
+
+void mremove(struct mblk_s *b)
+{
+  int i = mlevel(b->size & -8);
+  if (b->next) b->next->prev = b->prev;
+  if (b->prev) b->prev->next = b->next;
+  else if (!(mlist[i] = b->next) && !(mslmap[i / M_SL] &= ~(1 << (i & (M_SL - 1)))))
+    mflmap &= ~(1 << (i / M_SL));
+}
+
+// mark b free, merge it with free neighbours and list the result
+void mrelease(struct mblk_s *b)
+{
+  struct mblk_s *n, *p;
+  n = (struct mblk_s *)((char *)b + (b->size & -8));
+  if (n->size & M_FREE) { mremove(n); b->size += n->size & -8; }
+  if (b->size & M_PFREE) { p = (struct mblk_s *)((char *)b - b->psize); mremove(p); p->size += b->size & -8; b = p; }
+  b->size |= M_FREE;
+  n = (struct mblk_s *)((char *)b + (b->size & -8));
+  n->psize = b->size & -8;
+  n->size |= M_PFREE;
+  minsert(b);
+}
+
+// cut an in-use block b down to s bytes, releasing the tail
+void mtrim(struct mblk_s *b, uint s)
+{
+  struct mblk_s *t; uint r;
+  if ((r = (b->size & -8) - s) < M_MIN) return;
+  t = (struct mblk_s *)((char *)b + s);
+  t->size = r;
+  b->size -= r;
+  mrelease(t);
+}
+
+// add an arena of at least s usable bytes, joining it to the previous one when sbrk is contiguous
+int mgrow(uint s)
+{
+  struct mblk_s *b; char *p, *e; uint n;
+  n = (s + 3 * M_HDR + M_ARENA - 1) & -M_ARENA; // header, sentinel and alignment slop
+  if ((int)(p = sbrk(n)) == -1) return 0;
+  if (mtail && p == (char *)mtail + M_HDR) b = mtail; // old sentinel becomes the new block header
+  else { b = (struct mblk_s *)(((int)p + 7) & -8); b->size = 0; }
+  e = (char *)(((int)p + n) & -8) - M_HDR;
+  b->size = (e - (char *)b) | (b->size & M_PFREE);
+  mtail = (struct mblk_s *)e;
+  mtail->size = 0;
+  mrelease(b);
+  return 1;
+}
 
 void free(void *ptr)
 {
-  struct alloc_s *p, *q;
-
-  p = (struct alloc_s *)ptr - 1;
-  for (q = allocp; p <= q || p >= q->ptr; q = q->ptr)
-    if (q >= q->ptr && (p > q || p < q->ptr))
-      break;
-  if (p + p->size == q->ptr) {
-    p->size += q->ptr->size;
-    p->ptr = q->ptr->ptr;
-  } else
-    p->ptr = q->ptr;
-  if (q + q->size == p) {
-    q->size += p->size;
-    q->ptr = p->ptr;
-  } else
-    q->ptr = p;
-  allocp = q;
+  if (ptr) mrelease((struct mblk_s *)((char *)ptr - M_HDR));
 }
 
 void *malloc(uint n)
 {
-  static struct alloc_s base;
-  struct alloc_s *p, *q;
-  uint nu;
-
-  n = 1 + (n + sizeof(struct alloc_s) - 1) / sizeof(struct alloc_s);
-  if (!(q = allocp)) {
-    base.ptr = allocp = q = &base; // XXX do this with sbrk vs base?
-    base.size = 0;
-  }
-  for (p = q->ptr; ; q = p, p = p->ptr) {
-    if (p->size >= n) {
-      if (p->size == n)
-        q->ptr = p->ptr;
-      else {
-        p->size -= n;
-        p += p->size;
-        p->size = n;
-      }
-      allocp = q;
-      return (void *)(p + 1);
-    }
-    if (p == allocp) {
-      nu = n < 4096 ? 4096 : n;
-      p = (struct alloc_s *) sbrk(nu * sizeof(struct alloc_s));
-      if ((int)p == -1) return 0;
-      p->size = nu;
-      free((void *)(p + 1));
-      p = allocp;
-    }
+  struct mblk_s *b; uint s, r, m; int fl, i;
+
+  if (n > M_MAX) return 0;
+  if ((s = (n + M_HDR + 7) & -8) < M_MIN) s = M_MIN;
+  r = s + (1 << (mfls(s) - M_SLLOG)) - 1; // round up so any block on the chosen list fits
+  for (;;) {
+    i = mlevel(r);
+    fl = i / M_SL;
+    if ((m = mslmap[fl] & (-1 << (i & (M_SL - 1))))) i = fl * M_SL + mffs(m);
+    else if ((m = mflmap & (-1 << (fl + 1)))) { fl = mffs(m); i = fl * M_SL + mffs(mslmap[fl]); }
+    else if (mgrow(r)) continue;
+    else return 0;
+    break;
   }
+  b = mlist[i];
+  mremove(b);
+  b->size &= ~M_FREE;
+  ((struct mblk_s *)((char *)b + (b->size & -8)))->size &= ~M_PFREE;
+  mtrim(b, s);
+  return (char *)b + M_HDR;
 }
 
 void *memalign(uint bound, uint n)
 {
+  struct mblk_s *b, *a; char *p; uint g;
 
+  if (bound <= 8) return malloc(n);
+  if (n > M_MAX || bound > M_MAX - n) return 0;
+  if (!(p = malloc(n + bound + M_MIN))) return 0;
+  b = (struct mblk_s *)(p - M_HDR);
+  if ((g = -(int)p & (bound - 1)) && g < M_MIN) g += bound; // leading gap must hold a free block
+  if (g) {
+    a = (struct mblk_s *)((char *)b + g);
+    a->size = (b->size & -8) - g;
+    b->size = g | (b->size & M_PFREE);
+    mrelease(b);
+    b = a;
+  }
+  mtrim(b, ((n + M_HDR + 7) & -8) < M_MIN ? M_MIN : (n + M_HDR + 7) & -8);
+  return (char *)b + M_HDR;
 }
 
 void *realloc(void *ptr, uint n)
 {
+  struct mblk_s *b, *x; uint s, have; char *p;
 
+  if (!ptr) return malloc(n);
+  if (!n) { free(ptr); return 0; }
+  if (n > M_MAX) return 0;
+  b = (struct mblk_s *)((char *)ptr - M_HDR);
+  if ((s = (n + M_HDR + 7) & -8) < M_MIN) s = M_MIN;
+  have = b->size & -8;
+  if (have < s) {
+    x = (struct mblk_s *)((char *)b + have);
+    if ((x->size & M_FREE) && have + (x->size & -8) >= s) { // grow in place into the free neighbour
+      mremove(x);
+      b->size += x->size & -8;
+      ((struct mblk_s *)((char *)b + (b->size & -8)))->size &= ~M_PFREE;
+    } else {
+      if (!(p = malloc(n))) return 0;
+      memcpy(p, ptr, have - M_HDR);
+      free(ptr);
+      return p;
+    }
+  }
+  mtrim(b, s);
+  return ptr;
 }
-
@@ -21,7 +21,14 @@ enum {
   PSHG,POPG,NET1,NET2,NET3,NET4,NET5,NET6,NET7,NET8,NET9,
   POW ,ATN2,FABS,ATAN,LOG ,LOGT,EXP ,FLOR,CEIL,HYPO,SIN ,COS ,TAN ,ASIN, // math
   ACOS,SINH,COSH,TANH,SQRT,FMOD,
-  IDLE
+  IDLE,
+  VADD,VXOR,VAND,VCEQ,VMN ,VMX ,                                         // vector
+  MSLN,MSCM,                                                             // string
+  SVEC,SYSC,SYSR,LSYS,                                                   // fast system call
+  ICR ,ICW ,                                                             // interrupt controller
+  BANK,LUBK,SUBK,                                                        // register banks
+  CLK ,RTMR,                                                             // real time clock
+  SNAP,                                                                  // dirty page snapshots
 };
 
 // system calls
@@ -30,8 +37,19 @@ enum {
   S_exec,   S_open,   S_mknod,  S_unlink, S_fstat,  S_link,   S_mkdir,  S_chdir,
   S_dup2,   S_getpid, S_sbrk,   S_sleep,  S_uptime, S_lseek,  S_mount,  S_umount,
   S_socket, S_bind,   S_listen, S_poll,   S_accept, S_connect, 
+  S_ringsetup, S_ringenter,
 };
 
 typedef unsigned char uchar;
 typedef unsigned short ushort;
 typedef unsigned int uint;
+
+// system call ring -- user space queues calls in sq and the kernel runs everything between
+// sq_head and sq_tail on one S_ringenter trap, posting results in cq.  Each side only advances
+// its own index (user: sq_tail, cq_head; kernel: sq_head, cq_tail).  Indexes run freely and are
+// masked with RING_SZ - 1.
+enum { RING_SZ = 64 };
+
+struct sqe { int op, a, b, c, tag; }; // system call number and its arguments as for TRAP
+struct cqe { int res, tag; };         // return value
+struct ring { uint sq_head, sq_tail, cq_head, cq_tail; struct sqe sq[RING_SZ]; struct cqe cq[RING_SZ]; };
@@ -0,0 +1,16 @@
+// vec.h -- packed vector intrinsics
+//
+// Each routine applies d[i] = op(d[i], s[i]) lane by lane over n bytes.  The 32 versions work
+// on signed 32-bit lanes (d, s and n are rounded down to a multiple of 4), the 8 versions on
+// unsigned 8-bit lanes.  Compare sets a lane to all ones when equal, else zero.
+
+void vadd32() { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VADD,0); }
+void vadd8()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VADD,1); }
+void vxor()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VXOR,1); }
+void vand()   { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VAND,1); }
+void vceq32() { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VCEQ,0); }
+void vceq8()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VCEQ,1); }
+void vmin32() { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VMN,0); }
+void vmin8()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VMN,1); }
+void vmax32() { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VMX,0); }
+void vmax8()  { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(VMX,1); }
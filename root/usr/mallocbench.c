@@ -0,0 +1,49 @@
+// mallocbench.c -- libc malloc/free with mixed sizes and lifetimes
+//
+// Runs on the bare emulator.  bench.h's stand-in kernel serves the S_sbrk traps libc makes and
+// counts them, so the report shows how many allocations had to trap.
+
+#include <u.h>
+#include <libc.h>
+#include <bench.h>
+
+enum { SLOTS = 4096, STEPS = 200000 };
+
+char *slot[SLOTS];
+uint seed;
+
+uint rnd() { return seed = seed * 1103515245 + 12345; }
+
+uint size() // mostly small objects, a few medium and large ones
+{
+  uint r = rnd() >> 8;
+  if (r % 100 < 80) return 8 + (r >> 8) % 120;
+  if (r % 100 < 95) return 128 + (r >> 8) % 1920;
+  return 2048 + (r >> 8) % (62 * 1024);
+}
+
+main()
+{
+  int i, j, t, allocs;
+
+  bkernel();
+
+  seed = 1;
+  allocs = 0;
+  t = cyc();
+  for (i = 0; i < STEPS; i++) {
+    j = (rnd() >> 8) % SLOTS;
+    if (slot[j]) free(slot[j]);
+    if (!(slot[j] = malloc(size()))) break;
+    *slot[j] = i;
+    allocs++;
+    if (!(i & 3)) { j = (rnd() >> 8) % SLOTS; free(slot[j]); slot[j] = 0; } // some short lived objects
+  }
+  t = cyc() - t;
+
+  bputs("malloc+free: "); bputn(allocs); bputs(" allocations in "); bputn(t); bputs(" cycles, ");
+  bputn(t / allocs); bputs(" per allocation, "); bputn(bsbrks); bputs(" sbrk traps, heap grew to ");
+  bputn(bbrk / 1024); bputs(" KB");
+  bok(allocs == STEPS);
+  exit(0);
+}
@@ -0,0 +1,86 @@
+// membench.c -- mem.h malloc/free/realloc/memalign soak test
+//
+// Runs on the bare emulator.  Mixed sizes and lifetimes with data checks, realloc growth and
+// aligned allocations.  The heap is bench.h's fixed region, served by a direct sbrk() with no kernel.
+
+#include <u.h>
+#include <bench.h>
+
+enum { SLOTS = 4096, STEPS = 200000 };
+
+int bad;
+char *slot[SLOTS];
+uint len[SLOTS], seed;
+
+void *memcpy()  { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCPY); asm(LL,8); }
+void *memset()  { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); asm(LL,8); }
+void *sbrk(int n) { return bsbrk(n); }
+
+#include <mem.h>
+
+uint rnd() { return seed = seed * 1103515245 + 12345; }
+
+uint size() // mostly small objects, a few medium and large ones
+{
+  uint r = rnd() >> 8;
+  if (r % 100 < 80) return 8 + (r >> 8) % 120;
+  if (r % 100 < 95) return 128 + (r >> 8) % 1920;
+  return 2048 + (r >> 8) % (62 * 1024);
+}
+
+check(int j) // first and last byte still hold the slot tag
+{
+  if (slot[j] && (slot[j][0] != (char)j || slot[j][len[j] - 1] != (char)j)) bad++;
+}
+
+fill(int j, uint n) { len[j] = n; slot[j][0] = slot[j][n - 1] = j; }
+
+main()
+{
+  int i, j, t, ops, grown; uint n, a; char *p;
+
+  seed = 1;
+  ops = grown = 0;
+  t = cyc();
+  for (i = 0; i < STEPS; i++) {
+    j = (rnd() >> 8) % SLOTS;
+    check(j);
+    if (slot[j] && !(i & 7)) { // grow an existing object
+      n = len[j] + len[j] / 2 + 1;
+      p = slot[j];
+      if (!(slot[j] = realloc(p, n))) { bputs("out of memory FAILED\n"); asm(HALT); }
+      if (slot[j] == p) grown++;
+      slot[j][len[j] - 1] = 0;
+    } else {
+      free(slot[j]);
+      n = size();
+      if (!(slot[j] = malloc(n))) { bputs("out of memory FAILED\n"); asm(HALT); }
+    }
+    fill(j, n);
+    ops++;
+    if (!(i & 3)) { j = (rnd() >> 8) % SLOTS; check(j); free(slot[j]); slot[j] = 0; ops++; } // some short lived objects
+  }
+  t = cyc() - t;
+
+  bputs("mixed: "); bputn(ops); bputs(" operations in "); bputn(t); bputs(" cycles, "); bputn(t / ops);
+  bputs(" per op, "); bputn(grown); bputs(" reallocs in place");
+  bok(!bad);
+
+  for (a = 16; a <= 4096; a *= 2) { // aligned allocations among live objects
+    for (i = 0; i < 64; i++) {
+      j = (rnd() >> 8) % SLOTS;
+      check(j);
+      free(slot[j]);
+      n = size();
+      if (!(slot[j] = memalign(a, n))) { bputs("out of memory FAILED\n"); asm(HALT); }
+      if ((int)slot[j] & (a - 1)) bad++;
+      fill(j, n);
+    }
+  }
+
+  for (j = 0; j < SLOTS; j++) { check(j); free(slot[j]); }
+  bputs("aligned and coalesced: heap grew to "); bputn(bbrk / 1024); bputs(" KB in "); bputn(bsbrks); bputs(" sbrk calls");
+  p = malloc(bbrk - 2*1024*1024); // everything coalesced back, one big block fits again
+  bok(p && !bad);
+  asm(HALT);
+}
@@ -0,0 +1,63 @@
+// os10.c -- dirty page tracking: reset to a baseline and incremental snapshots
+//
+// A fuzzing style loop.  SNAP 0 takes a baseline, each round writes a few pages and SNAP 1 puts
+// back only the pages written since, then resumes after the SNAP 0 like longjmp.  A round costs
+// the pages it touched instead of a copy of all memory.  Round number and start time survive the
+// reset in a and c.  Run with em -s file and SNAP 2 appends the pages written since the last
+// snapshot to that file.
+
+#include <u.h>
+
+enum { ROUNDS = 1000, PAGES = 8, BIG = 16*1024*1024, STRIDE = 7*4096 + 4, MAGIC = 1234 };
+
+int seen = MAGIC; // part of the baseline, written every round
+
+out(port, val)   { asm(LL,8); asm(LBL,16); asm(BOUT); }
+halt(value)      { asm(LL,8); asm(HALT); }
+uint ns()        { asm(CLK,1); }
+memcpy()         { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(MCPY); asm(LL,8); }
+
+int base()       { asm(SNAP,0); }                      // 0, then the v of each reset()
+int restored()   { asm(PSHB); asm(POPA); }             // pages the reset put back, right after base()
+int carried()    { asm(PSHC); asm(POPA); }             // the w of the reset, right after base()
+reset(int v, int w) { asm(LL,8); asm(LCL,16); asm(SNAP,1); } // does not return
+int snapshot()   { asm(SNAP,2); }                      // pages written, -1 without em -s
+
+puts(char *s)    { while (*s) out(1, *s++); }
+putn(uint n)     { if (n >= 10) putn(n / 10); out(1, '0' + n % 10); }
+int at(int n, int i) { return (n * PAGES + i) * STRIDE % BIG; }
+
+main()
+{
+  int n, i, pages, k, j; uint t0, t; char *p;
+
+  p = (char *)(32*1024*1024); // above the program, below the stack
+  n = base();
+  pages = restored();
+  t0 = carried();
+  if (!n) t0 = ns();
+  else {
+    for (i = 0; i < PAGES; i++) if (p[at(n - 1, i)]) { puts("page not reset FAILED\n"); halt(-1); }
+    if (seen != MAGIC) { puts("global not reset FAILED\n"); halt(-1); }
+  }
+  if (n < ROUNDS) {
+    seen = n;
+    for (i = 0; i < PAGES; i++) p[at(n, i)] = 1;
+    reset(n + 1, t0);
+  }
+  t0 = ns() - t0;
+  puts("reset: "); putn(ROUNDS); puts(" rounds of "); putn(PAGES); puts(" pages, "); putn(pages); puts(" put back each, ");
+  putn(t0 / ROUNDS); puts(" ns per round "); puts(pages >= PAGES && pages <= PAGES + 4 ? "ok\n" : "FAILED\n");
+
+  t = ns();
+  memcpy(p + BIG, p, BIG);
+  t = ns() - t;
+  puts("for comparison one 16M copy: "); putn(t); puts(" ns\n");
+
+  if ((k = snapshot()) == -1) { puts("snapshot: no file, run with em -s\n"); halt(0); }
+  for (i = 0; i < PAGES; i++) p[at(0, i)] = 2;
+  j = snapshot();
+  puts("snapshot: "); putn(k); puts(" pages since the baseline, then "); putn(j); puts(" after writing "); putn(PAGES);
+  puts(j >= PAGES && j <= PAGES + 4 ? " ok\n" : " FAILED\n");
+  halt(0);
+}
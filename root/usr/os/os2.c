@@ -10,7 +10,7 @@ enum { // page table entry flags
 //PTE_PCD = 0x010,       // Cache-Disable
   PTE_A   = 0x020,       // Accessed
   PTE_D   = 0x040,       // Dirty
-//PTE_PS  = 0x080,       // Page Size
+  PTE_PS  = 0x080,       // Page Size
 //PTE_MBZ = 0x180,       // Bits must be zero
 };
 
@@ -0,0 +1,219 @@
+// os4.c -- system call paths: TRAP, the SYSC fast entry and the system call ring
+//
+// A single user task times a getpid() round trip through TRAP and through SYSC.  It then writes to
+// /dev/null with a kernel entry per call, then through the ring in u.h with one entry per batch.
+// em charges a kernel entry about as much as a few instructions.  So in a kernel this small the
+// ring's saving shows up in the entry count.  Cycles only drop once entry and exit cost more than
+// queueing does (paging, more state to save).
+
+#include <u.h>
+#include <libc.h>
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  USER=16 // user mode exception
+};
+
+enum { CONS = 1, DEVNULL = 3, DEVZERO = 4 }; // file descriptors
+
+enum { PAGE = 4096, UPAGES = 2 }; // the task's memory: its ring page, then its stack
+
+char task_mem[(UPAGES + 1) * PAGE]; // page aligned at run time into [ubase, uend)
+char task_kstack[1000];
+int *task_sp;
+uint ubase, uend; // the task's memory, a ring has to be a whole page of it
+
+struct ring *kring; // ring registered by the task
+int entries; // kernel entries for system calls
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+svec(void *sys) { asm(LL,8); asm(SVEC); }
+halt(value)     { asm(LL,8); asm(HALT); }
+int cyc()       { asm(CYC); }
+int msiz()      { asm(MSIZ); }
+
+// kernel
+
+int sys_write(int fd, char *p, int n) { int i; if (fd == CONS || fd == 2) for (i=0; i<n; i++) out(1, p[i]); else if (fd != DEVNULL) return -1; return n; }
+int sys_read(int fd, char *p, int n)  { if (fd != DEVZERO) return -1; memset(p, 0, n); return n; }
+int sys_open(char *name, int mode)    { if (!strcmp(name, "/dev/null")) return DEVNULL; if (!strcmp(name, "/dev/zero")) return DEVZERO; return -1; }
+
+int syscall(int n, int a, int b, int c)
+{
+  switch (n) {
+  case S_write: return sys_write(a, b, c);
+  case S_read:  return sys_read(a, b, c);
+  case S_open:  return sys_open(a, b);
+  case S_close: return 0;
+  default:      return -1;
+  }
+}
+
+// the ring is checked once when it is registered: a whole page of the task's memory and of physical
+// memory, so ringenter can use it as is.  The calls in it pass pointers the same way TRAP does.
+int sys_ringsetup(struct ring *r)
+{
+  if (sizeof(struct ring) > PAGE || ((uint)r & (PAGE - 1)) || (uint)r < ubase || (uint)r + PAGE > uend || (uint)r + PAGE > msiz()) return -1;
+  kring = r;
+  return 0;
+}
+
+// run queued calls until the submission queue is empty or the completion queue is full
+int sys_ringenter()
+{
+  struct ring *r; struct sqe *e; struct cqe *c; uint h, t;
+  if (!(r = kring)) return -1;
+  for (h = r->sq_head, t = r->cq_tail; h != r->sq_tail && t - r->cq_head < RING_SZ; h++, t++) {
+    e = &r->sq[h & (RING_SZ - 1)];
+    c = &r->cq[t & (RING_SZ - 1)];
+    c->res = syscall(e->op, e->a, e->b, e->c);
+    c->tag = e->tag;
+  }
+  t = h - r->sq_head;
+  r->sq_head = h;
+  r->cq_tail += t;
+  return t;
+}
+
+int sys(int n, int a, int b, int c)
+{
+  entries++;
+  switch (n) {
+  case S_exit:      halt(a);
+  case S_getpid:    return 1;
+  case S_ringsetup: return sys_ringsetup(a);
+  case S_ringenter: return sys_ringenter();
+  default:          return syscall(n, a, b, c);
+  }
+}
+
+trap(int *sp, int c, int b, int a, int fc, unsigned *pc)
+{
+  if (fc != FSYS + USER) { sys_write(CONS, "panic! unknown interrupt\n", 25); asm(HALT); }
+  a = sys(pc[-1] >> 8, a, b, c);
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  asm(LUSP); asm(PSHA);
+  trap();                // registers passed by reference/magic
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+sysent() // SYSC lands here with only the return pc pushed and the arguments still in a, b and c
+{
+  asm(PSHC);
+  asm(PSHB);
+  asm(PSHA);
+  asm(LSYS); asm(PSHA);
+  sys();                 // a = sys(n, a, b, c)
+  asm(POPB);
+  asm(POPB);
+  asm(POPB);
+  asm(POPC);
+  asm(SYSR);
+}
+
+trapret()
+{
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+// user task
+
+enum { CALLS = 20000, LEN = 16, BATCH = RING_SZ / 2 };
+
+struct ring *ring;
+char buf[LEN];
+
+int trap_getpid() { asm(TRAP,S_getpid); }
+
+int reap() { int res, tag, n; for (n = 0; ringreap(&res, &tag); ) if (res == LEN) n++; return n; }
+
+task()
+{
+  int i, t, n, fd, ok, res, tag;
+
+  t = cyc();
+  for (i = 0; i < CALLS; i++) trap_getpid();
+  t = cyc() - t;
+  n = cyc();
+  for (i = 0; i < CALLS; i++) getpid();
+  n = cyc() - n;
+  dprintf(CONS, "getpid round trip: TRAP %d cycles, SYSC %d cycles\n", t / CALLS, n / CALLS);
+
+  fd = open("/dev/null", O_WRONLY);
+  n = entries; t = cyc();
+  for (i = 0; i < CALLS; i++) write(fd, buf, LEN);
+  t = cyc() - t;
+  dprintf(CONS, "call per write: %d writes, %d kernel entries, %u cycles\n", CALLS, entries - n, t); // XXX kernel counters are visible without paging
+
+  ok = ringsetup(ubase + 8) < 0 && ringsetup(task_kstack) < 0 && ringsetup(uend) < 0;
+  dprintf(CONS, "ring setup refuses unaligned, kernel and out of range rings %s\n", ok ? "ok" : "FAILED");
+
+  ring = (struct ring *)ubase;
+  if (ringinit(ring) < 0) { dprintf(CONS, "ring setup FAILED\n"); exit(1); }
+  n = entries; ok = 0; t = cyc();
+  for (i = 0; i < CALLS; i++) {
+    ringwrite(fd, buf, LEN, i);
+    if ((i & (BATCH - 1)) == BATCH - 1) { ringenter(); ok += reap(); }
+  }
+  ringenter(); ok += reap();
+  t = cyc() - t;
+  dprintf(CONS, "ring:           %d writes, %d kernel entries, %u cycles %s\n", CALLS, entries - n, t, ok == CALLS ? "ok" : "FAILED");
+
+  buf[0] = 1; // open and read in one batch, the read uses the fd the open is known to return
+  ringopen("/dev/zero", O_RDONLY, 1);
+  ringread(DEVZERO, buf, LEN, 2);
+  ringenter();
+  ok = ringreap(&res, &tag) && tag == 1 && res == DEVZERO && ringreap(&res, &tag) && tag == 2 && res == LEN && !buf[0];
+  dprintf(CONS, "ring open+read %s\n", ok ? "ok" : "FAILED");
+  exit(0);
+}
+
+main()
+{
+  int *kstack;
+
+  ivec(alltraps);
+  svec(sysent);
+
+  ubase = ((uint)task_mem + PAGE - 1) & -PAGE;
+  uend = ubase + UPAGES * PAGE;
+
+  task_sp = (int *)((int)&task_kstack[1000] & -8); // RTI wants an 8 byte aligned frame
+  task_sp -= 2; *task_sp = &task;
+  task_sp -= 2; *task_sp = USER; // fault code
+  task_sp -= 2; *task_sp = 0; // a
+  task_sp -= 2; *task_sp = 0; // b
+  task_sp -= 2; *task_sp = 0; // c
+  task_sp -= 2; *task_sp = uend;
+  task_sp -= 2; *task_sp = &trapret;
+
+  kstack = task_sp;
+
+  asm(LL, 4); // a = kstack
+  asm(SSP);   // sp = a
+  asm(LEV);
+}
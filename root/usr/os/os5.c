@@ -0,0 +1,150 @@
+// os5.c -- vectored interrupts with priorities through the interrupt controller
+//
+// Times an interrupt delivered through ivec and a switch on the fault code against one delivered
+// straight to its own handler, then shows preemption, holding off and masking by priority.
+// Last the timer keeps ticking through one MSET of 64M, which yields as it runs out of cycles.
+
+#include <u.h>
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  USER=16 // user mode exception
+};
+
+enum { // interrupt controller registers
+  IC_CTRL, IC_MASK, IC_PEND, IC_ISR, IC_EOI, IC_VEC = 16, IC_PRI = 32
+};
+
+enum { FSOFT = 15, N = 10000 }; // FSOFT is a cause no device uses, raised by software
+enum { BIG = 64*1024*1024, TICK = 20000 };
+
+int count, done, ticks, last, gap;
+char log[32], *lp;
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+stmr(int val)   { asm(LL,8); asm(TIME); }
+int cyc()       { asm(CYC); }
+memset()        { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); }
+
+icctl(int v)    { asm(LL,8); asm(ICW,IC_CTRL); }
+icmask(int v)   { asm(LL,8); asm(ICW,IC_MASK); }
+int icpend()    { asm(ICR,IC_PEND); }
+icpost(int v)   { asm(LL,8); asm(ICW,IC_PEND); }
+eoi()           { asm(ICW,IC_EOI); }
+
+vtimer(void *f) { asm(LL,8); asm(ICW,IC_VEC+FTIMER); }
+vkeybd(void *f) { asm(LL,8); asm(ICW,IC_VEC+FKEYBD); }
+vsoft(void *f)  { asm(LL,8); asm(ICW,IC_VEC+FSOFT); }
+ptimer(int p)   { asm(LL,8); asm(ICW,IC_PRI+FTIMER); }
+pkeybd(int p)   { asm(LL,8); asm(ICW,IC_PRI+FKEYBD); }
+psoft(int p)    { asm(LL,8); asm(ICW,IC_PRI+FSOFT); }
+
+raise(int c)    { icpost(icpend() | 1 << c); }
+
+puts(char *s)   { while (*s) out(1, *s++); }
+putn(uint n)    { if (n >= 10) putn(n / 10); out(1, '0' + n % 10); }
+int same(char *s, char *t) { while (*s && *s == *t) { s++; t++; } return *s == *t; }
+
+// everything through ivec
+trap(int c, int b, int a, int fc, unsigned *pc)
+{
+  switch (fc) {
+  case FSOFT: count++; break;
+  default: puts("panic! unknown interrupt\n"); asm(HALT);
+  }
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  trap();
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+// one handler per cause
+timer()
+{
+  *lp++ = 'T';
+  asm(STI);         // let higher priorities in
+  raise(FKEYBD);    // outranks the timer, runs right away
+  *lp++ = 't';
+  asm(CLI);
+  stmr(0);
+  done = 1;
+  eoi();
+}
+
+keybd()
+{
+  *lp++ = 'K';
+  raise(FSOFT);     // below the keyboard, waits for its RTI
+  *lp++ = 'k';
+  eoi();
+}
+
+soft() { count++; if (lp) *lp++ = 'S'; eoi(); }
+
+tick() { int t; t = cyc(); if (ticks++ && t - last > gap) gap = t - last; last = t; eoi(); }
+
+timer_isr() { asm(PSHA); asm(PSHB); asm(PSHC); timer(); asm(POPC); asm(POPB); asm(POPA); asm(RTI); }
+keybd_isr() { asm(PSHA); asm(PSHB); asm(PSHC); keybd(); asm(POPC); asm(POPB); asm(POPA); asm(RTI); }
+soft_isr()  { asm(PSHA); asm(PSHB); asm(PSHC); soft();  asm(POPC); asm(POPB); asm(POPA); asm(RTI); }
+tick_isr()  { asm(PSHA); asm(PSHB); asm(PSHC); tick();  asm(POPC); asm(POPB); asm(POPA); asm(RTI); }
+
+main()
+{
+  int i, t; char *p;
+
+  ivec(alltraps);
+  asm(STI);
+
+  t = cyc();
+  for (i = 0; i < N; i++) raise(FSOFT);
+  t = cyc() - t;
+  puts("ivec and switch: "); putn(t / N); puts(" cycles per interrupt, "); putn(count); puts(" taken\n");
+
+  vtimer(timer_isr); vkeybd(keybd_isr); vsoft(soft_isr);
+  ptimer(1); psoft(2); pkeybd(3);
+  icctl(1);
+
+  count = 0;
+  t = cyc();
+  for (i = 0; i < N; i++) raise(FSOFT);
+  t = cyc() - t;
+  puts("vectored:        "); putn(t / N); puts(" cycles per interrupt, "); putn(count); puts(" taken\n");
+
+  lp = log;
+  stmr(1);
+  while (!done);
+  icmask(1 << FSOFT);
+  raise(FSOFT);
+  *lp++ = (icpend() & (1 << FSOFT)) ? 'm' : '?'; // held while masked
+  icmask(0);                                     // delivered as soon as it is unmasked
+  *lp = 0;
+  puts("timer T, keyboard K, soft S, masked m: "); puts(log);
+  puts(same(log, "TKkStmS") ? " ok\n" : " FAILED\n");
+
+  p = (char *)(32*1024*1024); // above the program, below the stack
+  vtimer(tick_isr);
+  stmr(TICK);
+  memset(p, 0x5a, BIG);
+  stmr(0);
+  puts("timer during a 64M MSET: "); putn(ticks); puts(" ticks, longest gap "); putn(gap); puts(" cycles");
+  puts(ticks > BIG / 8 / TICK / 2 && gap < 2 * TICK && p[0] == 0x5a && p[BIG / 2] == 0x5a && p[BIG - 1] == 0x5a ? " ok\n" : " FAILED\n");
+  asm(HALT);
+}
@@ -0,0 +1,192 @@
+// os6.c -- banked registers: kernel entry from user mode without saving a, b and c
+//
+// Task 0 times getpid() round trips through the usual alltraps, which saves and restores the
+// registers on the kernel stack, and then through a banked entry that does not.  After that the
+// timer switches between two tasks and the switch saves user registers through LUBK/SUBK.
+
+#include <u.h>
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  USER=16 // user mode exception
+};
+
+enum { N = 10000, SUMS = 204800, TICK = 5000 };
+
+struct task { int a, b, c, usp, *ksp, dead; } task[2];
+
+char task0_stack[4000], task0_kstack[1000];
+char task1_stack[4000], task1_kstack[1000];
+
+int current, calls;
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+bank(void *isr) { asm(LL,8); asm(BANK); }
+stmr(int val)   { asm(LL,8); asm(TIME); }
+halt(value)     { asm(LL,8); asm(HALT); }
+int cyc()       { asm(CYC); }
+
+int lubka()     { asm(LUBK,0); }
+int lubkb()     { asm(LUBK,1); }
+int lubkc()     { asm(LUBK,2); }
+subka(int v)    { asm(LL,8); asm(SUBK,0); }
+subkb(int v)    { asm(LL,8); asm(SUBK,1); }
+subkc(int v)    { asm(LL,8); asm(SUBK,2); }
+int lusp()      { asm(LUSP); }
+susp(int v)     { asm(LL,8); asm(SUSP); }
+
+swtch(int **old, int *new) // switch stacks
+{
+  asm(LEA, 0); // a = sp
+  asm(LBL, 8); // b = old
+  asm(SX, 0);  // *b = a
+  asm(LL, 16); // a = new
+  asm(SSP);    // sp = a
+}
+
+// run the other task.  Its user registers go into the user bank before its kernel stack is
+// switched to, since a new task starts with a plain RTI.
+resched()
+{
+  struct task *o, *n;
+  o = &task[current];
+  n = &task[current ^ 1];
+  if (n->dead) { if (o->dead) halt(0); return; }
+  current ^= 1;
+  o->a = lubka(); o->b = lubkb(); o->c = lubkc(); o->usp = lusp();
+  subka(n->a); subkb(n->b); subkc(n->c); susp(n->usp);
+  swtch(&o->ksp, n->ksp);
+}
+
+int sys(int n, int a, int b, int c)
+{
+  int i;
+  calls++;
+  switch (n) {
+  case S_getpid: return current + 1;
+  case S_write:  for (i = 0; i < c; i++) out(a, ((char *)b)[i]); return c;
+  case S_exit:   task[current].dead = 1; resched(); halt(0);
+  default:       return -1;
+  }
+}
+
+// banked entry from user mode, the user's a, b and c wait in the user bank
+utrap(int fc, unsigned *pc)
+{
+  switch (fc) {
+  case FSYS + USER:
+    if ((pc[-1] >> 8) == S_getpid) { calls++; subka(current + 1); } // no arguments, nothing to fetch
+    else subka(sys(pc[-1] >> 8, lubka(), lubkb(), lubkc()));
+    if (calls == 2 * N) stmr(TICK);
+    break;
+  case FTIMER + USER: resched(); break;
+  default: out(1, '!'); halt(-1);
+  }
+}
+
+uentry()
+{
+  utrap();
+  asm(RTI);
+}
+
+// entry without banks, and for interrupts that arrive in kernel mode
+trap(int c, int b, int a, int fc, unsigned *pc)
+{
+  switch (fc) {
+  case FSYS + USER:
+    a = sys(pc[-1] >> 8, a, b, c);
+    if (calls == N) { subka(a); subkb(b); subkc(c); bank(uentry); } // RTI below swaps these in
+    break;
+  case FTIMER: break; // arrived during a system call, switch on the next one
+  default: out(1, '!'); halt(-1);
+  }
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  trap();
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+uret() // first switch to a task lands here
+{
+  asm(RTI);
+}
+
+// user tasks
+
+int getpid()    { asm(TRAP,S_getpid); }
+write()         { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_write); }
+exit(int v)     { asm(LL,8); asm(TRAP,S_exit); }
+
+puts(char *s)   { int n; for (n = 0; s[n]; n++); write(1, s, n); }
+putn(uint n)    { char c; if (n >= 10) putn(n / 10); c = '0' + n % 10; write(1, &c, 1); }
+
+sums(int id) // register heavy loop the timer keeps interrupting
+{
+  int i; uint s;
+  for (i = s = 0; i < SUMS; i++) s += (i & 255) ^ id;
+  puts(id ? "task1" : "task0"); puts(s == SUMS / 256 * (255 * 256 / 2) ? " sums ok\n" : " sums FAILED\n");
+  exit(0);
+}
+
+task0()
+{
+  int i, t, u;
+  t = cyc();
+  for (i = 0; i < N; i++) getpid();
+  t = cyc() - t;
+  u = cyc();
+  for (i = 0; i < N; i++) getpid();
+  u = cyc() - u;
+  puts("getpid round trip: saving registers "); putn(t / N); puts(" cycles, banked "); putn(u / N); puts(" cycles\n");
+  sums(0);
+}
+
+task1() { sums(1); }
+
+int *newtask(char *kstack, char *ustack, void *entry) // kernel stack that uret()s to entry
+{
+  int *sp;
+  sp = (int *)((int)kstack & -8); // RTI wants an 8 byte aligned frame
+  sp -= 2; *sp = entry;
+  sp -= 2; *sp = USER; // fault code
+  sp -= 2; *sp = &uret;
+  return sp;
+}
+
+main()
+{
+  int *kstack;
+
+  ivec(alltraps);
+
+  task[0].ksp = newtask(&task0_kstack[1000], 0, &task0);
+  task[1].ksp = newtask(&task1_kstack[1000], 0, &task1);
+  task[0].usp = (int)&task0_stack[4000] & -8;
+  task[1].usp = (int)&task1_stack[4000] & -8;
+
+  susp(task[0].usp);
+  kstack = task[0].ksp;
+
+  asm(LL, 4); // a = kstack
+  asm(SSP);   // sp = a
+  asm(LEV);
+}
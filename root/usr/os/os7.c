@@ -0,0 +1,373 @@
+// os7.c -- O(1) priority scheduler for thousands of tasks, with sleep/wakeup and a switch benchmark
+//
+// Runnable tasks wait in a FIFO per priority and a bitmap of the non-empty FIFOs gives the highest
+// ready priority in one lookup, so picking the next task costs the same with 3 tasks or 3000.
+// Blocked tasks hang off a hash of wait channels and sleepers off a timer wheel.  Each task has
+// its own page directory over one shared identity map, so every switch also loads PDIR and the
+// emulator refills its TLB.
+//
+// The benchmark passes a byte back and forth through two pipes, two switches per round trip.  It
+// does this first with NPARK lower priority tasks runnable, then with all of them blocked, then it
+// wakes them all up.  Run it under time(1) to see what the emulator spends on switches and refills.
+
+#include <u.h>
+
+enum { // page table entry flags
+  PTE_P   = 0x001,       // Present
+  PTE_W   = 0x002,       // Writeable
+  PTE_U   = 0x004,       // User
+  PTE_PS  = 0x080,       // Page Size
+};
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  USER=16 // user mode exception
+};
+
+enum {
+  NTASK  = 2100,            // max tasks
+  NPRI   = 32,              // priorities, higher runs first
+  NCHAN  = 256,             // wait channel hash buckets
+  NWHEEL = 64,              // timer wheel slots
+  NPIPE  = 4, PIPESZ = 64,
+  PAGE   = 4096,
+  KMEM   = 8*1024*1024,     // free memory starts past the largest image xc makes
+  TICK   = 20000,           // cycles per timer tick
+};
+
+enum { FREE, RUN, READY, SLEEP }; // task states
+
+struct task {
+  int *ksp;                 // saved kernel stack pointer
+  int *pdir;                // page directory
+  struct task *next;        // run queue, wait channel or timer wheel link
+  void *chan;               // what a sleeping task waits for
+  int pri, state, pid;
+  uint wake;                // tick a timed sleep ends at
+};
+
+struct task task[NTASK], *current;
+int ntask, live, switches;
+
+struct task *runq[NPRI], *runqt[NPRI]; // head and tail of the FIFO for each priority
+uint ready;                            // bit p is set when runq[p] is not empty
+struct task *waitq[NCHAN];             // tasks blocked on a channel, by channel hash
+struct task *wheel[NWHEEL];            // tasks in a timed sleep, by wake tick
+uint ticks;
+
+struct pipe { uint r, w; char buf[PIPESZ]; } pipes[NPIPE]; // XXX made at boot, fds are global
+
+char *kmem;                            // next free page
+int *kpdir;                            // identity map all page directories copy
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+stmr(int val)   { asm(LL,8); asm(TIME); }
+pdir(value)     { asm(LL,8); asm(PDIR); }
+spage(value)    { asm(LL,8); asm(SPAG); }
+halt(value)     { asm(LL,8); asm(HALT); }
+int msiz()      { asm(MSIZ); }
+int cyc()       { asm(CYC); }
+
+void *memcpy() { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCPY); asm(LL,8); }
+void *memset() { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); asm(LL,8); }
+
+kputs(char *s)  { while (*s) out(1, *s++); }
+kputn(uint n)   { if (n >= 10) kputn(n / 10); out(1, '0' + n % 10); }
+
+// kernel
+
+int debruijn[32] = { 0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8, 31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9 };
+int hibit(uint x) { x |= x >> 1; x |= x >> 2; x |= x >> 4; x |= x >> 8; x |= x >> 16; x ^= x >> 1; return debruijn[x * 0x077CB531 >> 27]; } // x must be non-zero
+
+void *kalloc() { char *p; p = kmem; kmem += PAGE; return memset(p, 0, PAGE); }
+
+setrun(struct task *p) // queue behind the others of its priority
+{
+  p->state = READY;
+  p->next = 0;
+  if (runq[p->pri]) runqt[p->pri]->next = p; else { runq[p->pri] = p; ready |= 1 << p->pri; }
+  runqt[p->pri] = p;
+}
+
+struct task *pick() // first task of the highest ready priority, idle keeps ready non-zero
+{
+  struct task *p; int i;
+  p = runq[i = hibit(ready)];
+  if (!(runq[i] = p->next)) ready &= ~(1 << i);
+  return p;
+}
+
+swtch(int **old, int *new) // switch stacks
+{
+  asm(LEA, 0); // a = sp
+  asm(LBL, 8); // b = old
+  asm(SX, 0);  // *b = a
+  asm(LL, 16); // a = new
+  asm(SSP);    // sp = a
+}
+
+sched() // run the best ready task, current is already queued or blocked
+{
+  struct task *p, *o;
+  p = pick();
+  p->state = RUN;
+  if (p == current) return;
+  o = current;
+  current = p;
+  switches++;
+  pdir(p->pdir);
+  swtch(&o->ksp, p->ksp);
+}
+
+yield() { setrun(current); sched(); }
+
+ksleep(void *chan)
+{
+  struct task **q;
+  q = &waitq[(uint)chan >> 2 & (NCHAN - 1)];
+  current->chan = chan;
+  current->state = SLEEP;
+  current->next = *q;
+  *q = current;
+  sched();
+}
+
+int wakeup(void *chan, uint n) // make up to n tasks waiting on chan runnable
+{
+  struct task **q, *p; int i;
+  for (i = 0, q = &waitq[(uint)chan >> 2 & (NCHAN - 1)]; i < n && (p = *q); ) {
+    if (p->chan == chan) { *q = p->next; p->chan = 0; setrun(p); i++; } else q = &p->next;
+  }
+  return i;
+}
+
+tsleep(uint n) // sleep for n ticks, 0 only yields
+{
+  struct task **q;
+  if (!n) { yield(); return; }
+  current->wake = ticks + n;
+  q = &wheel[current->wake % NWHEEL];
+  current->chan = wheel;
+  current->state = SLEEP;
+  current->next = *q;
+  *q = current;
+  sched();
+}
+
+tick() // wake the sleepers due now, then round robin among equals
+{
+  struct task **q, *p;
+  ticks++;
+  for (q = &wheel[ticks % NWHEEL]; p = *q; ) {
+    if (p->wake == ticks) { *q = p->next; p->chan = 0; setrun(p); } else q = &p->next;
+  }
+  yield();
+}
+
+int sys_read(int fd, char *s, int n)
+{
+  struct pipe *pp; int i;
+  if ((fd -= 3) < 0 || (fd & 1) || (fd >>= 1) >= NPIPE) return -1;
+  pp = &pipes[fd];
+  while (pp->r == pp->w) ksleep(&pp->r);
+  for (i = 0; i < n && pp->r != pp->w; i++) s[i] = pp->buf[pp->r++ % PIPESZ];
+  wakeup(&pp->w, PIPESZ - (pp->w - pp->r)); // a writer for each free byte is enough
+  return i;
+}
+
+int sys_write(int fd, char *s, int n)
+{
+  struct pipe *pp; int i;
+  if (fd == 1 || fd == 2) { for (i = 0; i < n; i++) out(1, s[i]); return n; }
+  if ((fd -= 4) < 0 || (fd & 1) || (fd >>= 1) >= NPIPE) return -1;
+  pp = &pipes[fd];
+  for (i = 0; i < n; i++) {
+    while (pp->w - pp->r == PIPESZ) { wakeup(&pp->r, PIPESZ); ksleep(&pp->w); }
+    pp->buf[pp->w++ % PIPESZ] = s[i];
+  }
+  wakeup(&pp->r, pp->w - pp->r); // a reader for each byte waiting
+  return n;
+}
+
+sys_exit()
+{
+  current->state = FREE;
+  if (--live == 1) { kputs("exit: "); kputn(switches); kputs(" switches\n"); halt(0); } // only idle left
+  sched();
+}
+
+trap(int *sp, int c, int b, int a, int fc, unsigned *pc)
+{
+  switch (fc) {
+  case FSYS + USER:
+    switch (pc[-1] >> 8) {
+    case S_getpid: a = current->pid; break;
+    case S_read:   a = sys_read(a, b, c); break;
+    case S_write:  a = sys_write(a, b, c); break;
+    case S_sleep:  tsleep(a); a = 0; break;
+    case S_uptime: a = ticks; break;
+    case S_exit:   sys_exit();
+    default:       a = -1; break;
+    }
+    if (ready >> current->pri >> 1) yield(); // woke a higher priority
+    break;
+  case FTIMER + USER: tick(); break;
+  case FTIMER: break; // beat alltraps to its CLI, the next tick is not far off
+  default: kputs("panic! unknown interrupt\n"); halt(-1);
+  }
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(CLI);              // traps leave interrupts on, the queues are not safe against a tick
+  asm(PSHB);
+  asm(PSHC);
+  asm(LUSP); asm(PSHA);
+  trap();                // registers passed by reference/magic
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+trapret()
+{
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+spawn(void *entry, int pri) // new task that starts at entry in user mode
+{
+  struct task *p; int *sp;
+  p = &task[ntask++];
+  p->pid = ntask;
+  p->pri = pri;
+  p->pdir = memcpy(kalloc(), kpdir, PAGE);
+  sp = (int *)(kalloc() + PAGE);
+  sp -= 2; *sp = entry;
+  sp -= 2; *sp = USER; // fault code
+  sp -= 2; *sp = 0; // a
+  sp -= 2; *sp = 0; // b
+  sp -= 2; *sp = 0; // c
+  sp -= 2; *sp = (int)kalloc() + PAGE;
+  sp -= 2; *sp = &trapret;
+  p->ksp = sp;
+  live++;
+  setrun(p);
+}
+
+// user tasks
+
+enum { PINGR = 3, PINGW, PONGR, PONGW, PARKR, PARKW, ACKR, ACKW }; // pipe ends
+enum { NPARK = 2000, N = 10000 };
+
+int read()      { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_read); }
+int write()     { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_write); }
+exit(int v)     { asm(LL,8); asm(TRAP,S_exit); }
+sleep(int n)    { asm(LL,8); asm(TRAP,S_sleep); }
+int uptime()    { asm(TRAP,S_uptime); }
+
+puts(char *s)   { int n; for (n = 0; s[n]; n++); write(1, s, n); }
+putn(uint n)    { char c; if (n >= 10) putn(n / 10); c = '0' + n % 10; write(1, &c, 1); }
+
+idle() { for (;;); } // lowest priority, runs when everyone else is blocked
+
+ponger()
+{
+  char c;
+  while (read(PINGR, &c, 1) == 1 && c != 'q') write(PONGW, &c, 1);
+  exit(0);
+}
+
+parked()
+{
+  char c;
+  write(ACKW, "a", 1);
+  read(PARKR, &c, 1);
+  write(ACKW, "a", 1);
+  exit(0);
+}
+
+int pingpong() // cycles per switch, each has a write, a read and a pipe wakeup around it
+{
+  int i, t; char c;
+  c = 'p';
+  t = cyc();
+  for (i = 0; i < N; i++) { write(PINGW, &c, 1); read(PONGR, &c, 1); }
+  return (cyc() - t) / (2 * N);
+}
+
+int acks(int n) { char buf[PIPESZ]; while (n > 0) n -= read(ACKR, buf, PIPESZ); }
+
+bench()
+{
+  int a, b, t, i, n; char buf[PIPESZ];
+
+  a = pingpong();   // parked tasks still runnable below us
+  acks(NPARK);      // all of them blocked reading PARKR
+  b = pingpong();
+
+  memset(buf, 'w', PIPESZ);
+  t = cyc();
+  for (i = 0; i < NPARK; i += n) write(PARKW, buf, n = (NPARK - i < PIPESZ) ? NPARK - i : PIPESZ);
+  acks(NPARK);
+  t = cyc() - t;
+
+  puts("pipe switch: "); putn(a); puts(" cycles with "); putn(NPARK); puts(" tasks ready, ");
+  putn(b); puts(" with them blocked\n");
+  puts("wake and exit: "); putn(t / NPARK); puts(" cycles per task\n");
+
+  t = uptime();
+  sleep(3);         // the parked tasks are gone, idle runs meanwhile
+  puts((uint)(uptime() - t - 3) < 2 ? "sleep ok\n" : "sleep FAILED\n");
+  write(PINGW, "q", 1);
+  exit(0);
+}
+
+kinit()
+{
+  int i, n;
+
+  ivec(alltraps);
+  kmem = KMEM;
+  kpdir = kalloc();
+  for (n = msiz() >> 22, i = 0; i < n; i++) kpdir[i] = (i << 22) | PTE_PS | PTE_P | PTE_W | PTE_U; // identity map all of memory in 4M pages
+
+  spawn(&idle, 0);
+  spawn(&bench, 20);
+  spawn(&ponger, 20);
+  for (i = 0; i < NPARK; i++) spawn(&parked, 10);
+
+  current = pick();
+  current->state = RUN;
+  pdir(current->pdir);
+  spage(1);
+  stmr(TICK);
+}
+
+main()
+{
+  int *kstack;
+
+  kinit();
+  kstack = current->ksp;
+
+  asm(LL, 4); // a = kstack
+  asm(SSP);   // sp = a
+  asm(LEV);
+}
@@ -0,0 +1,486 @@
+// os8.c -- demand paging: copy on write fork, demand zero heap and stack, clock page reclaim
+//
+// User memory lives between UBASE and USTACK and starts out unmapped.  Pages appear on the first
+// FRPAGE/FWPAGE: zero filled below brk or just under the stack pointer, copied when a write hits a
+// page fork() shared (PTE_COW), read back when the page was swapped out (PTE_SWAP).  Frames are
+// few on purpose, so the heap test overflows them.  A clock hand then evicts user pages not used
+// since it last passed (PTE_A) and skips the copy for pages clean since swap in (PTE_D).  The swap
+// area is just more memory, the point is the paging traffic.
+//
+// em drops a translation only on PDIR or SPAG, so the kernel reloads PDIR after it takes rights
+// away (fork, eviction, clearing PTE_A, shrinking).  Adding rights needs nothing, em walks again.
+
+#include <u.h>
+
+enum { // page table entry flags
+  PTE_P    = 0x001,      // Present
+  PTE_W    = 0x002,      // Writeable
+  PTE_U    = 0x004,      // User
+  PTE_A    = 0x020,      // Accessed
+  PTE_D    = 0x040,      // Dirty
+  PTE_PS   = 0x080,      // Page Size
+  PTE_COW  = 0x200,      // shared by fork, copy on write (ignored by em)
+  PTE_SWAP = 0x400,      // not present, swap slot in the address bits (ignored by em)
+};
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  USER=16 // user mode exception
+};
+
+enum {
+  PAGE   = 4096,
+  KMEM   = 8*1024*1024,     // free memory starts past the largest image xc makes
+  UBASE  = 0x40000000,      // user heap starts here
+  USTACK = 0x70000000,      // user stack grows down from here
+  SMAX   = 1024*1024,       // max user stack
+  NFRAME = 1024,            // page frames, kernel and user
+  NSWAP  = 4096,            // swap slots, slot 0 means none
+  NPROC  = 64,
+};
+
+enum { UNUSED, RUN, WAIT, ZOMBIE }; // process states
+
+struct proc {
+  int *ksp;                 // saved kernel stack pointer
+  int *pdir;                // page directory
+  char *kstack;
+  uint brk;                 // end of the heap
+  int pid, state, xstatus;
+  struct proc *parent;
+};
+
+struct proc proc[NPROC], *current;
+int nextpid;
+
+int *kpdir;                 // kernel half all page directories copy
+char *frames, *swapmem;
+int *freelist;              // free frames, linked through their first word
+int ref[NFRAME];            // mappings of each frame
+int *rmap[NFRAME];          // the pte of an unshared user page, the only ones the clock takes
+int sslot[NFRAME];          // swap slot still holding a copy of the frame
+int sfreelist, snext[NSWAP], hand;
+
+int nzero, ncopy, nreuse, nswapout, nclean, nswapin, nchance, nfault; uint fcycles; // paging counters
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+pdir(value)     { asm(LL,8); asm(PDIR); }
+spage(value)    { asm(LL,8); asm(SPAG); }
+halt(value)     { asm(LL,8); asm(HALT); }
+uint lvad()     { asm(LVAD); }
+int msiz()      { asm(MSIZ); }
+int cyc()       { asm(CYC); }
+
+void *memcpy() { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCPY); asm(LL,8); }
+void *memset() { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); asm(LL,8); }
+
+kputs(char *s)  { while (*s) out(1, *s++); }
+kputn(uint n)   { if (n >= 10) kputn(n / 10); out(1, '0' + n % 10); }
+panic(char *s)  { kputs("panic! "); kputs(s); kputs("\n"); halt(-1); }
+
+// swap slots and frames
+
+int salloc() { int s; if (!(s = sfreelist)) panic("out of swap"); sfreelist = snext[s]; return s; }
+sfree(int s) { snext[s] = sfreelist; sfreelist = s; }
+
+int fi(uint p) { return (p - (uint)frames) >> 12; } // frame index of a frame address or pte
+
+reclaim() // clock: evict the first user page not used since the hand last came by
+{
+  int i, n, *pte; char *f;
+  for (n = 0; n <= 2 * NFRAME; n++) {
+    i = hand; hand = (hand + 1) & (NFRAME - 1);
+    if (!(pte = rmap[i])) continue;
+    if (*pte & PTE_A) { *pte &= ~PTE_A; nchance++; continue; } // second chance
+    f = frames + i * PAGE;
+    if (!sslot[i]) { sslot[i] = salloc(); memcpy(swapmem + sslot[i] * PAGE, f, PAGE); nswapout++; }
+    else if (*pte & PTE_D) { memcpy(swapmem + sslot[i] * PAGE, f, PAGE); nswapout++; }
+    else nclean++;                                  // swap still has it
+    *pte = sslot[i] << 12 | PTE_SWAP;               // the slot goes with the pte now
+    sslot[i] = 0; rmap[i] = 0; ref[i] = 0;
+    *(int **)f = freelist; freelist = f;
+    pdir(current->pdir);                            // drop the evicted page and the cleared PTE_A
+    return;
+  }
+  panic("out of memory");
+}
+
+void *palloc() // zeroed frame, evicting a user page if none are free
+{
+  int *p;
+  if (!freelist) reclaim();
+  p = freelist; freelist = *(int **)p;
+  ref[fi(p)] = 1;
+  return memset(p, 0, PAGE);
+}
+
+pfree(void *p)
+{
+  int i;
+  i = fi(p);
+  if (sslot[i]) { sfree(sslot[i]); sslot[i] = 0; }
+  rmap[i] = 0; ref[i] = 0;
+  *(int **)p = freelist; freelist = p;
+}
+
+unref(uint pte) { if (!--ref[fi(pte)]) pfree(pte & -PAGE); }
+
+// address spaces
+
+int *walk(int *pd, uint va, int alloc) // pte of va, making the page table if alloc
+{
+  int *pde;
+  pde = &pd[va >> 22];
+  if (!(*pde & PTE_P)) { if (!alloc) return 0; *pde = (int)palloc() | PTE_P | PTE_W | PTE_U; }
+  return (int *)(*pde & -PAGE) + (va >> 12 & 1023);
+}
+
+swapin(int *pte)
+{
+  int s; char *f;
+  s = (uint)*pte >> 12;
+  f = palloc();
+  memcpy(f, swapmem + s * PAGE, PAGE);
+  sslot[fi(f)] = s;                                 // keep the copy, evicting it again is free while clean
+  rmap[fi(f)] = pte;
+  *pte = (int)f | PTE_P | PTE_W | PTE_U;
+  nswapin++;
+}
+
+unmap(int *pd, uint lo, uint hi) // release user pages in [lo, hi)
+{
+  int *pte;
+  for (; lo < hi; lo += PAGE) {
+    if (!(pte = walk(pd, lo, 0))) { lo = (lo | (PAGE * 1024 - 1)) - PAGE + 1; continue; } // no page table
+    if (*pte & PTE_P) unref(*pte); else if (*pte & PTE_SWAP) sfree((uint)*pte >> 12);
+    *pte = 0;
+  }
+}
+
+freeuvm(int *pd) // release all user pages and their page tables
+{
+  int i;
+  unmap(pd, UBASE, current->brk);
+  unmap(pd, USTACK - SMAX, USTACK);
+  for (i = UBASE >> 22; i < USTACK >> 22; i++) if (pd[i] & PTE_P) { pfree(pd[i] & -PAGE); pd[i] = 0; }
+}
+
+int fault(uint va, int write, uint usp) // make va usable, -1 if it is not a legal address
+{
+  int *pte, i; char *f;
+  if (va < UBASE || va >= USTACK) return -1;
+  pte = walk(current->pdir, va, 1);
+  if (*pte & PTE_P) {
+    if (!write || !(*pte & PTE_COW)) return -1;     // a real protection fault
+    i = fi(*pte);
+    if (ref[i] == 1) { *pte = (*pte | PTE_W) & ~PTE_COW; rmap[i] = pte; nreuse++; } // last one sharing
+    else {
+      f = memcpy(palloc(), *pte & -PAGE, PAGE);
+      ref[i]--;
+      *pte = (int)f | PTE_P | PTE_W | PTE_U;
+      rmap[fi(f)] = pte;
+      ncopy++;
+    }
+  }
+  else if (*pte & PTE_SWAP) swapin(pte);
+  else if (va < current->brk || (va >= USTACK - SMAX && va >= usp - PAGE)) { // heap, or stack growth
+    f = palloc();
+    *pte = (int)f | PTE_P | PTE_W | PTE_U;
+    rmap[fi(f)] = pte;
+    nzero++;
+  }
+  else return -1;
+  return 0;
+}
+
+// processes
+
+swtch(int **old, int *new) // switch stacks
+{
+  asm(LEA, 0); // a = sp
+  asm(LBL, 8); // b = old
+  asm(SX, 0);  // *b = a
+  asm(LL, 16); // a = new
+  asm(SSP);    // sp = a
+}
+
+sched() // run the next runnable process after current
+{
+  struct proc *p, *o; int i, n;
+  for (n = NPROC, i = current->pid; n--; i++) if ((p = &proc[i % NPROC])->state == RUN) break;
+  if (p->state != RUN) panic("deadlock");
+  if (p == current) return;
+  o = current;
+  current = p;
+  pdir(p->pdir);
+  swtch(&o->ksp, p->ksp);
+}
+
+trapret()
+{
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+struct proc *newproc(uint usp, int c, int b, int a, uint pc) // process that RTIs to pc in user mode
+{
+  struct proc *p; int i, *sp;
+  for (i = 0; i < NPROC && proc[i].state != UNUSED; i++);
+  if (i == NPROC) return 0;
+  p = &proc[i];
+  p->pid = ++nextpid;
+  p->pdir = memcpy(palloc(), kpdir, PAGE);
+  p->kstack = palloc();
+  sp = (int *)(p->kstack + PAGE);
+  sp -= 2; *sp = pc;
+  sp -= 2; *sp = USER; // fault code
+  sp -= 2; *sp = a;
+  sp -= 2; *sp = b;
+  sp -= 2; *sp = c;
+  sp -= 2; *sp = usp;
+  sp -= 2; *sp = &trapret;
+  p->ksp = sp;
+  p->brk = UBASE;
+  p->parent = current;
+  p->state = RUN;
+  return p;
+}
+
+int sys_fork(uint usp, int c, int b, uint pc) // child shares every user page copy on write
+{
+  struct proc *np; int i, j, *pt, *npt, pte;
+  if (!(np = newproc(usp, c, b, 0, pc))) return -1;
+  np->brk = current->brk;
+  for (i = UBASE >> 22; i < USTACK >> 22; i++) {
+    if (!(current->pdir[i] & PTE_P)) continue;
+    pt = current->pdir[i] & -PAGE;
+    npt = palloc();
+    np->pdir[i] = (int)npt | PTE_P | PTE_W | PTE_U;
+    for (j = 0; j < 1024; j++) {
+      if (pt[j] & PTE_SWAP) swapin(&pt[j]);         // XXX share the slot instead
+      if (!((pte = pt[j]) & PTE_P)) continue;
+      if (pte & PTE_W) pte = pte & ~PTE_W | PTE_COW;
+      pt[j] = npt[j] = pte;
+      ref[fi(pte)]++;
+      rmap[fi(pte)] = 0;                            // XXX shared pages stay unevictable until written
+    }
+  }
+  pdir(current->pdir);                              // the parent lost write access
+  return np->pid;
+}
+
+int sys_sbrk(int n)
+{
+  uint old;
+  old = current->brk;
+  if (n < 0) {
+    if (old + n < UBASE) return -1;
+    unmap(current->pdir, (old + n + PAGE - 1) & -PAGE, old);
+    pdir(current->pdir);
+  }
+  else if (old + n >= USTACK - SMAX || old + n < old) return -1;
+  current->brk = old + n;
+  return old;
+}
+
+sys_exit(int v)
+{
+  int i;
+  freeuvm(current->pdir);
+  pdir(current->pdir);
+  for (i = 0; i < NPROC; i++) if (proc[i].parent == current) proc[i].parent = &proc[0];
+  current->xstatus = v;
+  current->state = ZOMBIE;
+  if (current == &proc[0]) {
+    kputs("faults "); kputn(nfault); kputs(", "); kputn(fcycles / nfault); kputs(" cycles each: zero fill "); kputn(nzero);
+    kputs(", cow copy "); kputn(ncopy); kputs(", cow reuse "); kputn(nreuse); kputs(", swap in "); kputn(nswapin);
+    kputs("\nclock: swap out "); kputn(nswapout); kputs(", clean evict "); kputn(nclean); kputs(", second chance "); kputn(nchance); kputs("\n");
+    halt(0);
+  }
+  if (current->parent->state == WAIT) current->parent->state = RUN;
+  sched();
+}
+
+int sys_wait(int *status)
+{
+  struct proc *p; int i, kids, pid;
+  for (;;) {
+    for (kids = i = 0; i < NPROC; i++) {
+      if ((p = &proc[i])->parent != current || p->state == UNUSED) continue;
+      kids++;
+      if (p->state != ZOMBIE) continue;
+      if (status) *status = p->xstatus;             // may fault, copy on write in the kernel too
+      pfree(p->pdir); pfree(p->kstack);
+      p->state = UNUSED; p->parent = 0;
+      return p->pid;
+    }
+    if (!kids) return -1;
+    current->state = WAIT;
+    sched();
+  }
+}
+
+int sys_write(int fd, char *s, int n) { int i; for (i = 0; i < n; i++) out(1, s[i]); return n; }
+
+trap(uint *sp, int c, int b, int a, int fc, uint pc)
+{
+  uint t, va;
+  switch (fc) {
+  case FSYS + USER:
+    switch (((uint *)pc)[-1] >> 8) {
+    case S_fork:   a = sys_fork(sp, c, b, pc); break;
+    case S_exit:   sys_exit(a);
+    case S_wait:   a = sys_wait(a); break;
+    case S_sbrk:   a = sys_sbrk(a); break;
+    case S_write:  a = sys_write(a, b, c); break;
+    case S_getpid: a = current->pid; break;
+    default:       a = -1; break;
+    }
+    break;
+  case FRPAGE: case FWPAGE: // kernel touching user memory for a system call
+  case FRPAGE + USER: case FWPAGE + USER:
+    t = cyc();
+    va = lvad();
+    if (fault(va, (fc & 15) == FWPAGE, sp)) {
+      if (!(fc & USER) && va < UBASE) panic("kernel page fault");
+      kputs("pid "); kputn(current->pid); kputs(": segmentation fault\n");
+      sys_exit(-1);
+    }
+    pc -= 4;             // em saves the pc past the faulting instruction, run it again
+    nfault++; fcycles += cyc() - t;
+    break;
+  case FIPAGE + USER: case FINST + USER: case FPRIV + USER: case FARITH + USER:
+    kputs("pid "); kputn(current->pid); kputs(": bad instruction\n");
+    sys_exit(-1);
+  default: panic("unknown interrupt");
+  }
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  asm(LUSP); asm(PSHA);
+  trap();                // registers passed by reference/magic
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+// user process, only the stack and heap are private so no globals here
+
+enum { HEAP = 6*1024*1024, SHARED = 64, NCHILD = 8, DEPTH = 100 };
+
+int fork()      { asm(TRAP,S_fork); }
+int wait()      { asm(LL,8); asm(TRAP,S_wait); }
+void *sbrk()    { asm(LL,8); asm(TRAP,S_sbrk); }
+int write()     { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_write); }
+exit(int v)     { asm(LL,8); asm(TRAP,S_exit); }
+
+puts(char *s)   { int n; for (n = 0; s[n]; n++); write(1, s, n); }
+putn(uint n)    { char c; if (n >= 10) putn(n / 10); c = '0' + n % 10; write(1, &c, 1); }
+result(char *s, int ok, int t) { puts(s); puts(ok ? " ok, " : " FAILED, "); putn(t); puts(" cycles\n"); }
+
+int heap() // more heap than frames: written once, then read twice
+{
+  int *p, i, n, ok;
+  p = sbrk(HEAP);
+  n = HEAP / 4;
+  for (i = 0; i < n; i += 1024) p[i] = i;
+  for (ok = 1, i = 0; i < n; i += 1024) if (p[i] != i) ok = 0;
+  for (i = 0; i < n; i += 1024) if (p[i] != i) ok = 0; // evictions now mostly clean
+  sbrk(-HEAP);
+  return ok;
+}
+
+int cow() // children read the parent's pages and write a few, the parent's stay as they were
+{
+  int *p, i, j, ok, st;
+  p = sbrk(SHARED * PAGE);
+  for (i = 0; i < SHARED; i++) p[i * 1024] = i;
+  for (j = 0; j < NCHILD; j++) {
+    if (fork()) continue;
+    for (ok = 1, i = 0; i < SHARED; i++) if (p[i * 1024] != i) ok = 0;
+    for (i = j; i < SHARED; i += NCHILD) p[i * 1024] = -1;
+    exit(ok);
+  }
+  for (ok = 1, j = 0; j < NCHILD; j++) { st = 0; wait(&st); ok &= st; }
+  for (i = 0; i < SHARED; i++) if (p[i * 1024] != i) ok = 0;
+  for (i = 0; i < SHARED; i++) p[i * 1024] = i + 1; // unshared by now, written in place
+  sbrk(-SHARED * PAGE);
+  return ok;
+}
+
+int deep(int n) // about a page of stack per level
+{
+  char pad[4000];
+  pad[0] = n; pad[3999] = n;
+  if (!n) return 0;
+  return deep(n - 1) + pad[0] + pad[3999] - n;
+}
+
+int segv()
+{
+  int st;
+  if (!fork()) { *(int *)(USTACK - 2 * SMAX) = 1; exit(0); } // neither heap nor stack
+  wait(&st);
+  return st == -1;
+}
+
+init()
+{
+  int t, ok;
+  t = cyc(); ok = heap(); result("demand zero heap, swap out and in:", ok, cyc() - t);
+  t = cyc(); ok = cow();  result("copy on write fork:", ok, cyc() - t);
+  t = cyc(); ok = deep(DEPTH) == DEPTH * (DEPTH + 1) / 2; result("stack growth:", ok, cyc() - t);
+  t = cyc(); ok = segv(); result("bad address kills the child:", ok, cyc() - t);
+  exit(0);
+}
+
+kinit()
+{
+  int i, n; char *p;
+
+  ivec(alltraps);
+
+  n = msiz() >> 22;
+  p = KMEM;
+  kpdir = p; p += PAGE;
+  for (i = 0; i < n; i++) kpdir[i] = (i << 22) | PTE_PS | PTE_P | PTE_W | (i < KMEM >> 22 ? PTE_U : 0); // identity map all of memory in 4M pages, the image user accessible
+  for (frames = p, i = 0; i < NFRAME; i++) pfree(frames + i * PAGE);
+  swapmem = frames + NFRAME * PAGE;
+  for (i = NSWAP - 1; i; i--) sfree(i);
+
+  current = newproc(USTACK, 0, 0, 0, &init);
+  current->parent = 0;
+  pdir(current->pdir);
+  spage(1);
+}
+
+main()
+{
+  int *kstack;
+
+  kinit();
+  kstack = current->ksp;
+
+  asm(LL, 4); // a = kstack
+  asm(SSP);   // sp = a
+  asm(LEV);
+}
@@ -0,0 +1,157 @@
+// os9.c -- real time: S_uptime from the CLK clock, S_sleep from a one shot RTMR, a periodic RTMR
+//
+// The cycle timer (TIME) counts emulated instructions, so its time depends on how fast em runs.
+// CLK reads the host monotonic clock and RTMR raises FCLOCK after so many microseconds of it.
+// IDLE sleeps on the host until the deadline instead of spinning.
+
+#include <u.h>
+
+enum {    // processor fault codes
+  FMEM,   // bad physical address
+  FTIMER, // timer interrupt
+  FKEYBD, // keyboard interrupt
+  FPRIV,  // privileged instruction
+  FINST,  // illegal instruction
+  FSYS,   // software trap
+  FARITH, // arithmetic trap
+  FIPAGE, // page fault on opcode fetch
+  FWPAGE, // page fault on write
+  FRPAGE, // page fault on read
+  FCLOCK, // real time timer interrupt
+  USER=16 // user mode exception
+};
+
+enum { N = 10000, TICKS = 10 };
+
+char task_stack[4000];
+char task_kstack[1000];
+int *task_sp;
+
+int rings;  // FCLOCK interrupts taken
+uint t0;
+
+out(port, val)  { asm(LL,8); asm(LBL,16); asm(BOUT); }
+ivec(void *isr) { asm(LL,8); asm(IVEC); }
+halt(value)     { asm(LL,8); asm(HALT); }
+uint us()       { asm(CLK,0); }
+uint ns()       { asm(CLK,1); }
+rtmr(uint us)   { asm(LL,8); asm(RTMR,0); }
+rtper(uint us)  { asm(LL,8); asm(RTMR,1); }
+
+// kernel
+
+int sys_write(int fd, char *p, int n) { int i; for (i = 0; i < n; i++) out(1, p[i]); return n; }
+
+kputs(char *s)  { int n; for (n = 0; s[n]; n++); sys_write(1, s, n); }
+kputn(uint n)   { if (n >= 10) kputn(n / 10); out(1, '0' + n % 10); }
+
+sys_sleep(uint ms) // system calls run with interrupts on, so IDLE can wait for the alarm here
+{
+  int n;
+  if (!ms) return;
+  n = rings;
+  rtmr(ms * 1000);
+  while (rings == n) asm(IDLE);
+}
+
+trap(int *sp, int c, int b, int a, int fc, unsigned *pc)
+{
+  switch (fc) {
+  case FSYS + USER:
+    switch (pc[-1] >> 8) {
+    case S_write:  a = sys_write(a, b, c); break;
+    case S_sleep:  sys_sleep(a); a = 0; break;
+    case S_uptime: a = us() / 1000; break;
+    case S_getpid: a = 1; break;
+    case S_exit:   halt(a);
+    default:       a = -1; break;
+    }
+    break;
+  case FCLOCK: case FCLOCK + USER: rings++; break;
+  default: sys_write(1, "panic! unknown interrupt\n", 25); halt(-1);
+  }
+}
+
+alltraps()
+{
+  asm(PSHA);
+  asm(PSHB);
+  asm(PSHC);
+  asm(LUSP); asm(PSHA);
+  trap();                // registers passed by reference/magic
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+trapret()
+{
+  asm(POPA); asm(SUSP);
+  asm(POPC);
+  asm(POPB);
+  asm(POPA);
+  asm(RTI);
+}
+
+// user task
+
+int write()     { asm(LL,8); asm(LBL,16); asm(LCL,24); asm(TRAP,S_write); }
+sleep(int ms)   { asm(LL,8); asm(TRAP,S_sleep); }
+int uptime()    { asm(TRAP,S_uptime); }
+int getpid()    { asm(TRAP,S_getpid); }
+exit(int v)     { asm(LL,8); asm(TRAP,S_exit); }
+
+puts(char *s)   { int n; for (n = 0; s[n]; n++); write(1, s, n); }
+putn(uint n)    { char c; if (n >= 10) putn(n / 10); c = '0' + n % 10; write(1, &c, 1); }
+
+task()
+{
+  int i, t, ms;
+
+  for (ms = 10; ms <= 40; ms *= 2) {
+    t = us();
+    sleep(ms);
+    t = us() - t;
+    puts("sleep("); putn(ms); puts(") took "); putn(t); puts(" us "); puts(t >= ms * 1000 && t < ms * 1000 + 20000 ? "ok\n" : "FAILED\n");
+  }
+
+  t = ns();
+  for (i = 0; i < N; i++) getpid();
+  t = ns() - t;
+  puts("getpid round trip: "); putn(t / N); puts(" ns of host time\n");
+  exit(0);
+}
+
+main()
+{
+  int *kstack;
+
+  ivec(alltraps);
+
+  // periodic timer, idling between ticks
+  t0 = us();
+  asm(STI);
+  rtper(10000);
+  while (rings < TICKS) asm(IDLE);
+  rtper(0);
+  asm(CLI);
+  t0 = us() - t0;
+  kputs("periodic 10 ms: "); kputn(TICKS); kputs(" ticks in "); kputn(t0 / 1000); kputs(" ms "); kputs(t0 >= 100000 && t0 < 200000 ? "ok\n" : "FAILED\n");
+
+  task_sp = (int *)((int)&task_kstack[1000] & -8); // RTI wants an 8 byte aligned frame
+  task_sp -= 2; *task_sp = &task;
+  task_sp -= 2; *task_sp = USER; // fault code
+  task_sp -= 2; *task_sp = 0; // a
+  task_sp -= 2; *task_sp = 0; // b
+  task_sp -= 2; *task_sp = 0; // c
+  task_sp -= 2; *task_sp = (int)&task_stack[4000] & -8;
+  task_sp -= 2; *task_sp = &trapret;
+
+  kstack = task_sp;
+
+  asm(LL, 4); // a = kstack
+  asm(SSP);   // sp = a
+  asm(LEV);
+}
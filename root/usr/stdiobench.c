@@ -0,0 +1,70 @@
+// stdiobench.c -- system calls made by unbuffered and buffered stdio
+//
+// Runs on the bare emulator on bench.h's stand-in kernel.  Its bsys hook keeps an in-memory file:
+// stdout writes go to it and stdin reads come back from it, while stderr goes to the console.
+
+#include <u.h>
+#include <libc.h>
+#include <bench.h>
+
+enum { LINES = 20000, FILE_SZ = 512*1024 };
+
+char disk[FILE_SZ];
+int size, pos, writes, reads;
+
+int sys(int n, int *a, int b, int c)
+{
+  switch (n) {
+  case S_write:
+    if (*a == 2) return 0;
+    writes++;
+    if (c > FILE_SZ - size) c = FILE_SZ - size;
+    memcpy(disk + size, (char *)b, c); size += c; *a = c; return 1;
+  case S_read:
+    reads++;
+    if (c > size - pos) c = size - pos;
+    memcpy((char *)b, disk + pos, c); pos += c; *a = c; return 1;
+  case S_fstat: ((struct stat *)b)->st_mode = S_IFREG; *a = 0; return 1;
+  case S_lseek: *a = -1; return 1;
+  }
+  return 0;
+}
+
+line(char *name, int calls, uint t, int ok) { bputs(name); bputn(calls); bputs(" calls, "); bputn(t); bputs(" cycles"); bok(ok); }
+
+int emit() // a typical report line built from several calls
+{
+  int i, t = cyc();
+  for (i = 0; i < LINES; i++) { printf("%d", i); fputs(" squared is ", stdout); printf("%d", i * i); putchar('\n'); }
+  fflush(stdout);
+  return cyc() - t;
+}
+
+main()
+{
+  int i, t, n, sum, bytes; char buf[80], c;
+
+  bsys = sys;
+  bkernel();
+
+  setvbuf(stdout, 0, _IONBF, 0);
+  writes = 0; t = emit(); bytes = size;
+  line("unbuffered write: ", writes, t, bytes > 0);
+
+  size = 0;
+  setvbuf(stdout, 0, _IOFBF, 0);
+  writes = 0; t = emit();
+  line("buffered write:   ", writes, t, size == bytes);
+
+  reads = 0; pos = 0; n = 0; t = cyc();
+  while (read(0, &c, 1) == 1) if (c == '\n') n++;
+  t = cyc() - t;
+  line("read(1) scan:     ", reads, t, n == LINES);
+
+  reads = 0; pos = 0; n = sum = 0; t = cyc();
+  while (fgets(buf, sizeof(buf), stdin)) { n++; sum += atoi(buf); }
+  t = cyc() - t;
+  line("fgets scan:       ", reads, t, n == LINES && sum == (LINES - 1) * LINES / 2);
+
+  exit(0);
+}
@@ -0,0 +1,72 @@
+// vecbench.c -- compare scalar loops with the packed vector instructions
+//
+// Runs on the bare emulator (no kernel needed):  xc -o vecbench -Iroot/lib root/usr/vecbench.c; em vecbench
+// Each line gives emulated cycles and the host time em spent on both versions, with their ratios.
+
+#include <u.h>
+#include <vec.h>
+#include <bench.h>
+
+enum { N = 64*1024, PASSES = 16 };
+
+char src[N], dst[N], tmp[N];
+
+void *memcpy()  { asm(LL,8); asm(LBL, 16); asm(LCL,24); asm(MCPY); asm(LL,8); }
+void *memset()  { asm(LL,8); asm(LBLB,16); asm(LCL,24); asm(MSET); asm(LL,8); }
+
+report(char *name, uint scalar, uint vector, uint hs, uint hv, int ok)
+{
+  bputs(name); bputs(": scalar "); bputn(scalar); bputs(" vector "); bputn(vector);
+  bputs(" cycles, speedup "); bputn(vector ? scalar / vector : 0); bputs("x; host ");
+  bputn(hs / 1000); bputs(" vs "); bputn(hv / 1000); bputs(" us, speedup "); bputn(hv ? hs / hv : 0); bputs("x");
+  bok(ok);
+}
+
+main()
+{
+  int i, j, t, scalar, vector, ok; uint x, *w, h, hs, hv;
+
+  for (i = 0; i < N; i++) src[i] = i * 7;
+
+  // brighten: byte lanes, dst += src
+  memset(dst, 3, N);
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) for (i = 0; i < N; i++) dst[i] += src[i];
+  scalar = cyc() - t; hs = bns() - h;
+  memcpy(tmp, dst, N);
+  memset(dst, 3, N);
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) vadd8(dst, src, N);
+  vector = cyc() - t; hv = bns() - h;
+  for (ok = 1, i = 0; i < N; i++) if (dst[i] != tmp[i]) ok = 0;
+  report("vadd8", scalar, vector, hs, hv, ok);
+
+  // clamp: unsigned byte max
+  memset(dst, 100, N);
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) for (i = 0; i < N; i++) if ((uchar)dst[i] < (uchar)src[i]) dst[i] = src[i];
+  scalar = cyc() - t; hs = bns() - h;
+  memcpy(tmp, dst, N);
+  memset(dst, 100, N);
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) vmax8(dst, src, N);
+  vector = cyc() - t; hv = bns() - h;
+  for (ok = 1, i = 0; i < N; i++) if (dst[i] != tmp[i]) ok = 0;
+  report("vmax8", scalar, vector, hs, hv, ok);
+
+  // checksum: xor of all words, vector version folds the buffer in halves
+  w = (uint *)src;
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) for (x = i = 0; i < N / 4; i++) x ^= w[i];
+  scalar = cyc() - t; hs = bns() - h;
+  h = bns(); t = cyc();
+  for (j = 0; j < PASSES; j++) {
+    memcpy(tmp, src, N);
+    for (i = N / 2; i >= 16; i /= 2) vxor(tmp, tmp + i, i);
+  }
+  vector = cyc() - t; hv = bns() - h;
+  w = (uint *)tmp;
+  report("vxor", scalar, vector, hs, hv, x == (w[0] ^ w[1] ^ w[2] ^ w[3]));
+
+  asm(HALT);
+}